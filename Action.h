@@ -12,7 +12,9 @@ enum class ActionType {
 	MENU,
 	SELECT,
 
-	PAUSE
+	PAUSE,
+
+	PROFILE
 };
 
 enum class ActionState {
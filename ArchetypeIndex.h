@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "ComponentContainer.h"
+#include "SparseHashmap.h"
+
+namespace MattECS {
+	// one bit per registered component id.
+	typedef uint64_t ComponentMask;
+	const size_t MAX_COMPONENTS = 64;
+
+	// Every entity with exactly the same set of components. Rows line up across the
+	// columns: columns[c][row] is where the row's entity sits in component c's
+	// container, so a query over a table never has to look an entity up.
+	struct Archetype {
+		ComponentMask mask;
+		std::vector<EntityID> entities;
+		// indexed by component id, empty for components not in mask.
+		std::vector<std::vector<size_t>> columns;
+
+		bool has(size_t component) const {
+			return (mask & ((ComponentMask)1 << component)) != 0;
+		}
+		size_t size() const {
+			return entities.size();
+		}
+	};
+
+	// Groups entities by their component set. The components themselves stay in
+	// their containers (double buffered and ordered as usual), the tables only hold
+	// where each one lives. EntityManager keeps them up to date at end_frame.
+	class ArchetypeIndex {
+	public:
+		ArchetypeIndex() {}
+
+		const std::vector<Archetype>& tables() const {
+			return _tables;
+		}
+
+		ComponentMask mask_of(EntityID id) const {
+			auto slot = id & SPARSE_SLOT_MASK;
+			if (slot >= _locations.size() || !_locations[slot].table) {
+				return 0;
+			}
+			return _tables[_locations[slot].table.value()].mask;
+		}
+
+		// Moves the entity into the table for mask, an empty mask drops it.
+		void set(EntityID id, ComponentMask mask, const std::vector<IComponentContainer*>& containers) {
+			remove(id);
+			if (mask == 0) {
+				return;
+			}
+
+			size_t t = _table_for(mask, containers.size());
+			Archetype& table = _tables[t];
+			size_t row = table.entities.size();
+			table.entities.push_back(id);
+			for (size_t c = 0; c < containers.size(); c++) {
+				if (table.has(c)) {
+					auto index = containers[c]->index_of(id);
+					assert(index);
+					table.columns[c].push_back(index.value());
+				}
+			}
+
+			auto slot = id & SPARSE_SLOT_MASK;
+			if (slot >= _locations.size()) {
+				_locations.resize(slot + 1);
+			}
+			_locations[slot] = Location{ t, row };
+		}
+
+		void remove(EntityID id) {
+			auto slot = id & SPARSE_SLOT_MASK;
+			if (slot >= _locations.size() || !_locations[slot].table) {
+				return;
+			}
+			Archetype& table = _tables[_locations[slot].table.value()];
+			size_t row = _locations[slot].row;
+			// the slot may hold another generation of the entity by now.
+			if (table.entities[row] != id) {
+				return;
+			}
+			size_t last = table.entities.size() - 1;
+
+			// swap the last row into the hole, same as the containers do.
+			if (row != last) {
+				table.entities[row] = table.entities[last];
+				for (auto& column : table.columns) {
+					if (!column.empty()) {
+						column[row] = column[last];
+					}
+				}
+				_locations[table.entities[row] & SPARSE_SLOT_MASK].row = row;
+			}
+			table.entities.pop_back();
+			for (auto& column : table.columns) {
+				if (!column.empty()) {
+					column.pop_back();
+				}
+			}
+			_locations[slot].table = {};
+		}
+
+		// component's container now keeps the entity at index.
+		void relocate(size_t component, EntityID id, size_t index) {
+			auto slot = id & SPARSE_SLOT_MASK;
+			if (slot >= _locations.size() || !_locations[slot].table) {
+				return;
+			}
+			Archetype& table = _tables[_locations[slot].table.value()];
+			if (table.has(component) && table.entities[_locations[slot].row] == id) {
+				table.columns[component][_locations[slot].row] = index;
+			}
+		}
+
+		// Every row points at its entity in each of its components' containers. Slow,
+		// for asserts after anything that moves a lot around.
+		bool matches(const std::vector<IComponentContainer*>& containers) const {
+			for (const auto& table : _tables) {
+				for (size_t c = 0; c < containers.size(); c++) {
+					if (!table.has(c)) {
+						continue;
+					}
+					for (size_t row = 0; row < table.size(); row++) {
+						size_t index = table.columns[c][row];
+						if (index >= containers[c]->entity_count() || containers[c]->entity_at(index) != table.entities[row]) {
+							return false;
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+	private:
+		struct Location {
+			std::optional<size_t> table;
+			size_t row;
+		};
+
+		size_t _table_for(ComponentMask mask, size_t components) {
+			auto found = _table_of_mask.find(mask);
+			if (found != _table_of_mask.end()) {
+				return found->second;
+			}
+			Archetype table;
+			table.mask = mask;
+			table.columns.resize(components);
+			_tables.push_back(table);
+			_table_of_mask[mask] = _tables.size() - 1;
+			return _tables.size() - 1;
+		}
+
+		std::unordered_map<ComponentMask, size_t> _table_of_mask;
+		std::vector<Archetype> _tables;
+		// by entity slot.
+		std::vector<Location> _locations;
+	};
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -10,6 +12,9 @@
 #include "Action.h"
 #include "EntityManager.h"
 #include "GameManager.h"
+#include "Profiler.h"
+#include "SystemScheduler.h"
+#include "SystemTimings.h"
 
 //enum class SceneStage {
 //	// These occur per game loop.
@@ -62,6 +67,13 @@ public:
 	virtual void RenderGUI(GameManager& gm, sf::RenderWindow& window, int last_render) = 0;
 
 	virtual void EndLoop(GameManager& gm) = 0;
+
+	// Fingerprint of the simulation state, checked after every tick on replay.
+	// Only what FixedUpdate decides should go in, never render or GUI state.
+	virtual uint64_t StateHash() = 0;
+
+	// Times every FixedUpdate system into timings from now on, nullptr stops.
+	virtual void SetSystemTimings(SystemTimings* timings) = 0;
 };
 
 template <typename Derived>
@@ -79,6 +91,8 @@ public:
 	// FixedUpdate systems expect to be run at a fixed rate and thus can expect a
 	// fixed step length. This is often 20ms (50hz). It is possible for a loop to
 	// not run fixed update and possible for a loop to run multiple fixed updates.
+	// Systems registered with the components they read and write may run at the
+	// same time as others they don't conflict with.
 	typedef std::function<void(Derived&, GameManager&)> FixedUpdateSystem;
 
 	// Render systems are run at a different rate than fixed update and may not
@@ -109,32 +123,60 @@ public:
 
 	void EndLoop(GameManager& gm);
 
+	// 0 unless the scene has state worth checking.
+	virtual uint64_t StateHash();
+
+	void SetSystemTimings(SystemTimings* timings);
+
 	// System management methods
-	void RegisterBeginLoopSystem(LoopSystem system);
-	void RegisterEndLoopSystem(LoopSystem system);
-	void RegisterActionSystem(ActionSystem system);
-	void RegisterFixedUpdateSystem(FixedUpdateSystem system);
-	void RegisterRenderSystem(RenderSystem system);
-	void RegisterRenderGUISystem(RenderSystem system);
+	// name is what timings and profiles call the system, by default the stage
+	// and the order it was registered in.
+	void RegisterBeginLoopSystem(LoopSystem system, const std::string& name = "");
+	void RegisterEndLoopSystem(LoopSystem system, const std::string& name = "");
+	void RegisterActionSystem(ActionSystem system, const std::string& name = "");
+	void RegisterFixedUpdateSystem(FixedUpdateSystem system, const SystemAccess& access = SystemAccess::exclusive(), const std::string& name = "");
+	void RegisterRenderSystem(RenderSystem system, const std::string& name = "");
+	void RegisterRenderGUISystem(RenderSystem system, const std::string& name = "");
 
 	MattECS::EntityManager& entity_manager();
 
 private:
+	template <typename F>
+	struct Registered {
+		F system;
+		// index into _system_names.
+		size_t slot;
+	};
+
 	MattECS::EntityManager _entity_manager;
 	// std::unordered_map<SceneStage, std::vector<System>> _systems;
-	std::vector<LoopSystem> _begin_loop_systems;
-	std::vector<LoopSystem> _end_loop_systems;
-	std::vector<ActionSystem> _action_systems;
-	std::vector<FixedUpdateSystem> _fixed_systems;
-	std::vector<RenderSystem> _render_systems;
-	std::vector<RenderSystem> _gui_systems;
+	std::vector<Registered<LoopSystem>> _begin_loop_systems;
+	std::vector<Registered<LoopSystem>> _end_loop_systems;
+	std::vector<Registered<ActionSystem>> _action_systems;
+	std::vector<Registered<FixedUpdateSystem>> _fixed_systems;
+	SystemScheduler _fixed_scheduler;
+	SystemTimings* _timings;
+	std::vector<Registered<RenderSystem>> _render_systems;
+	std::vector<Registered<RenderSystem>> _gui_systems;
+
+	// every system of every stage.
+	std::vector<std::string> _system_names;
+	// profiler ids of _system_names, then of finalize_update and end_frame.
+	std::vector<uint32_t> _profile_ids;
+	uint32_t _finalize_profile_id;
+	uint32_t _end_frame_profile_id;
+
+	template <typename F>
+	void _register(std::vector<Registered<F>>& systems, F system, const std::string& stage, const std::string& name);
+	// looks up the profiler ids of systems registered since the last call.
+	void _update_profile_ids(Profiler& profiler);
 
 	template <typename F, typename... Args>
-	void _run_systems(std::vector<F>& systems, Args... args);
+	void _run_systems(std::vector<Registered<F>>& systems, GameManager& gm, Args... args);
 };
 
 template<typename Derived>
-BaseScene<Derived>::BaseScene() {}
+BaseScene<Derived>::BaseScene() : _timings(nullptr), _finalize_profile_id(0), _end_frame_profile_id(0) {}
 
 template <typename Derived>
 BaseScene<Derived>::~BaseScene() {}
@@ -162,77 +204,135 @@ std::optional<SceneError> BaseScene<Derived>::Hide(GameManager& gm) {
 
 // System management methods
 template <typename Derived>
-void BaseScene<Derived>::RegisterBeginLoopSystem(LoopSystem system) {
-	_begin_loop_systems.push_back(system);
+void BaseScene<Derived>::RegisterBeginLoopSystem(LoopSystem system, const std::string& name) {
+	_register(_begin_loop_systems, system, "BeginLoop", name);
+}
+template <typename Derived>
+void BaseScene<Derived>::RegisterEndLoopSystem(LoopSystem system, const std::string& name) {
+	_register(_end_loop_systems, system, "EndLoop", name);
 }
 template <typename Derived>
-void BaseScene<Derived>::RegisterEndLoopSystem(LoopSystem system) {
-	_end_loop_systems.push_back(system);
+void BaseScene<Derived>::RegisterActionSystem(ActionSystem system, const std::string& name) {
+	_register(_action_systems, system, "Action", name);
 }
 template <typename Derived>
-void BaseScene<Derived>::RegisterActionSystem(ActionSystem system) {
-	_action_systems.push_back(system);
+void BaseScene<Derived>::RegisterFixedUpdateSystem(FixedUpdateSystem system, const SystemAccess& access, const std::string& name) {
+	_register(_fixed_systems, system, "FixedUpdate", name);
+	_fixed_scheduler.add(access);
 }
 template <typename Derived>
-void BaseScene<Derived>::RegisterFixedUpdateSystem(FixedUpdateSystem system) {
-	_fixed_systems.push_back(system);
+void BaseScene<Derived>::RegisterRenderSystem(RenderSystem system, const std::string& name) {
+	_register(_render_systems, system, "Render", name);
 }
 template <typename Derived>
-void BaseScene<Derived>::RegisterRenderSystem(RenderSystem system) {
-	_render_systems.push_back(system);
+void BaseScene<Derived>::RegisterRenderGUISystem(RenderSystem system, const std::string& name) {
+	_register(_gui_systems, system, "RenderGUI", name);
 }
+
+template <typename Derived>
+template <typename F>
+void BaseScene<Derived>::_register(std::vector<Registered<F>>& systems, F system, const std::string& stage, const std::string& name) {
+	systems.push_back(Registered<F>{ system, _system_names.size() });
+	_system_names.push_back(name.empty() ? stage + " " + std::to_string(systems.size() - 1) : name);
+}
+
 template <typename Derived>
-void BaseScene<Derived>::RegisterRenderGUISystem(RenderSystem system) {
-	_gui_systems.push_back(system);
+void BaseScene<Derived>::_update_profile_ids(Profiler& profiler) {
+	if (_profile_ids.size() == _system_names.size()) {
+		return;
+	}
+	for (size_t i = _profile_ids.size(); i < _system_names.size(); i++) {
+		_profile_ids.push_back(profiler.name_id(_system_names[i]));
+	}
+	_finalize_profile_id = profiler.name_id("finalize_update");
+	_end_frame_profile_id = profiler.name_id("end_frame");
 }
 
 template <typename Derived>
 template <typename F, typename... Args>
-void BaseScene<Derived>::_run_systems(std::vector<F>& systems, Args... args) {
+void BaseScene<Derived>::_run_systems(std::vector<Registered<F>>& systems, GameManager& gm, Args... args) {
 	if (systems.size() == 0) {
 		return;
 	}
-	for (auto s : systems) {
-		s(*static_cast<Derived*>(this), args...);
+	Profiler& profiler = gm.profiler();
+	_update_profile_ids(profiler);
+	for (auto& s : systems) {
+		Profiler::Scope scope(profiler, _profile_ids[s.slot]);
+		s.system(*static_cast<Derived*>(this), gm, args...);
 	}
+	Profiler::Scope scope(profiler, _finalize_profile_id);
 	_entity_manager.finalize_update();
 }
 
 template <typename Derived>
 void BaseScene<Derived>::BeginLoop(GameManager& gm) {
-	_run_systems<LoopSystem, GameManager&>(_begin_loop_systems, gm);
+	_run_systems<LoopSystem>(_begin_loop_systems, gm);
 }
 
 template <typename Derived>
 void BaseScene<Derived>::OnAction(GameManager& gm, const std::vector<Action>& actions, const std::unordered_map<ActionType, ActionState>& action_states) {
-	if (_action_systems.size() == 0) {
-		return;
-	}
-	for (auto s : _action_systems) {
-		s(*static_cast<Derived*>(this), gm, actions, action_states);
-	}
-	_entity_manager.finalize_update();
+	_run_systems<ActionSystem, const std::vector<Action>&, const std::unordered_map<ActionType, ActionState>&>(_action_systems, gm, actions, action_states);
 }
 
 template <typename Derived>
 void BaseScene<Derived>::FixedUpdate(GameManager& gm) {
-	_run_systems<FixedUpdateSystem, GameManager&>(_fixed_systems, gm);
-	_entity_manager.end_frame();
+	Profiler& profiler = gm.profiler();
+	_update_profile_ids(profiler);
+	sf::Clock tick_clock;
+	if (_fixed_systems.size() > 0) {
+		Derived& scene = *static_cast<Derived*>(this);
+		_fixed_scheduler.run([this, &scene, &gm, &profiler](size_t i) {
+			Profiler::Scope scope(profiler, _profile_ids[_fixed_systems[i].slot]);
+			if (!_timings) {
+				_fixed_systems[i].system(scene, gm);
+				return;
+			}
+			sf::Clock clock;
+			_fixed_systems[i].system(scene, gm);
+			_timings->add(i, clock.getElapsedTime().asMicroseconds());
+		});
+		Profiler::Scope scope(profiler, _finalize_profile_id);
+		_entity_manager.finalize_update();
+	}
+	{
+		Profiler::Scope scope(profiler, _end_frame_profile_id);
+		_entity_manager.end_frame();
+	}
+	if (_timings) {
+		_timings->add_tick(tick_clock.getElapsedTime().asMicroseconds());
+	}
 }
 
 template <typename Derived>
 void BaseScene<Derived>::Render(GameManager& gm, sf::RenderWindow& window, int last_render) {
-	_run_systems<RenderSystem, GameManager&, sf::RenderWindow&, int>(_render_systems, gm, window, last_render);
+	_run_systems<RenderSystem, sf::RenderWindow&, int>(_render_systems, gm, window, last_render);
 }
 
 template <typename Derived>
 void BaseScene<Derived>::RenderGUI(GameManager& gm, sf::RenderWindow& window, int last_render) {
-	_run_systems<RenderSystem, GameManager&, sf::RenderWindow&, int>(_gui_systems, gm, window, last_render);
+	_run_systems<RenderSystem, sf::RenderWindow&, int>(_gui_systems, gm, window, last_render);
 }
 
 template <typename Derived>
 void BaseScene<Derived>::EndLoop(GameManager& gm) {
-	_run_systems<LoopSystem, GameManager&>(_end_loop_systems, gm);
+	_run_systems<LoopSystem>(_end_loop_systems, gm);
+}
+
+template <typename Derived>
+uint64_t BaseScene<Derived>::StateHash() {
+	return 0;
+}
+
+template <typename Derived>
+void BaseScene<Derived>::SetSystemTimings(SystemTimings* timings) {
+	_timings = timings;
+	if (_timings) {
+		std::vector<std::string> names;
+		for (const auto& s : _fixed_systems) {
+			names.push_back(_system_names[s.slot]);
+		}
+		_timings->reset(names);
+	}
 }
 
 template <typename Derived>
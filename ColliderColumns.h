@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Components.h"
+
+// The boxes of the dynamic colliders laid out one array per field, indexed by
+// the collider's row in the collider view. Narrowphase tests read just these,
+// the AABB and Transform themselves are only touched once two boxes overlap.
+// Whoever moves a box has to move it here too.
+struct ColliderColumns {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> half_w;
+	std::vector<float> half_h;
+	// 0 for Permeable boxes.
+	std::vector<uint8_t> solid;
+
+	void resize(size_t rows) {
+		x.resize(rows);
+		y.resize(rows);
+		half_w.resize(rows);
+		half_h.resize(rows);
+		solid.resize(rows);
+	}
+	size_t size() const {
+		return x.size();
+	}
+
+	void set(size_t row, const sf::Vector2f& position, const AABB& aabb) {
+		x[row] = position.x;
+		y[row] = position.y;
+		half_w[row] = aabb.half_size.x;
+		half_h[row] = aabb.half_size.y;
+		solid[row] = aabb.material != AABB::Material::Permeable;
+	}
+	void move(size_t row, const sf::Vector2f& position) {
+		x[row] = position.x;
+		y[row] = position.y;
+	}
+
+	sf::Vector2f position(size_t row) const {
+		return sf::Vector2f(x[row], y[row]);
+	}
+	sf::Vector2f half_size(size_t row) const {
+		return sf::Vector2f(half_w[row], half_h[row]);
+	}
+};
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <algorithm>
 #include <iostream>
 #include <functional>
+#include <mutex>
 #include <optional>
 #include <tuple>
 #include <typeindex>
@@ -18,19 +21,58 @@
 namespace MattECS {
 	typedef size_t EntityID;
 
+	// [first, last) of the indices an orderer moved elements around in.
+	struct SortedRange {
+		size_t first;
+		size_t last;
+
+		bool empty() const { return first >= last; }
+		void add(size_t index) {
+			first = std::min(first, index);
+			last = std::max(last, index + 1);
+		}
+	};
+	const SortedRange NOTHING_MOVED = { SIZE_MAX, 0 };
+
 	class IComponentContainer {
 	public:
 		virtual ~IComponentContainer() = default;
 		virtual void end_frame() = 0;
 		virtual void update_all() = 0;
 		virtual void delete_item(EntityID id) = 0;
+
+		// Type erased access to the live layout, used to index archetypes.
+		virtual std::optional<size_t> index_of(EntityID id) const = 0;
+		virtual size_t entity_count() const = 0;
+		virtual EntityID entity_at(size_t index) const = 0;
+		// bumped by every end_frame that added, removed or moved elements.
+		virtual size_t layout_version() const = 0;
+		// what the end_frame that last bumped layout_version did. Rebuilt means any index may have changed.
+		virtual bool layout_rebuilt() const = 0;
+		virtual SortedRange layout_moved() const = 0;
+
+		// Keep enough to undo the last ticks end_frames, 0 turns history off. Drops
+		// whatever history there was.
+		virtual void set_history(size_t ticks) = 0;
+		// Puts back what the container held ticks end_frames ago and drops anything
+		// not committed yet. Entities that gained or lost the component go in touched.
+		virtual void rewind(size_t ticks, std::vector<EntityID>& touched) = 0;
 	};
 
+	// Orderers get the indices of the elements that were added or changed since the
+	// last sort and must leave the container ordered. They return what they moved.
 	template <typename C>
-	void no_orderer(std::vector<size_t>& indices, SparseHashmap<EntityID, C>& values) {
+	SortedRange no_orderer(const std::vector<size_t>& changed, SparseHashmap<EntityID, C>& values) {
+		return NOTHING_MOVED;
 	}
-	template <typename C, typename bool(*Less)(const C&, const C&)>
-	void less_than_orderer(std::vector<size_t>& indices, SparseHashmap<EntityID, C>& data) {
+
+	// Timsorts the whole container, only the keys that moved get their index fixed.
+	template <typename C, bool(*Less)(const C&, const C&)>
+	SortedRange full_less_than_orderer(SparseHashmap<EntityID, C>& data) {
+		std::vector<size_t> indices(data.size());
+		for (size_t i = 0; i < data.size(); i++) {
+			indices[i] = i;
+		}
 		gfx::timsort(
 			indices,
 			Less,
@@ -38,6 +80,70 @@ namespace MattECS {
 				return data.value_at(index);
 			}
 		);
+
+		SortedRange moved = NOTHING_MOVED;
+		for (size_t i = 0; i < indices.size(); i++) {
+			if (indices[i] != i) {
+				moved.add(i);
+			}
+		}
+		if (!moved.empty()) {
+			data.apply_sort(indices);
+		}
+		return moved;
+	}
+
+	// When only a few elements changed, each is walked from its old index to where
+	// it belongs. Everything else was already in order, so this costs about the
+	// distance the changed elements moved. Lots of changes fall back to a timsort.
+	template <typename C, bool(*Less)(const C&, const C&)>
+	SortedRange less_than_orderer(const std::vector<size_t>& changed, SparseHashmap<EntityID, C>& data) {
+		if (changed.size() * 4 > data.size()) {
+			return full_less_than_orderer<C, Less>(data);
+		}
+
+		// indices shift as things are swapped, so follow the elements by id.
+		std::vector<EntityID> ids;
+		ids.reserve(changed.size());
+		for (auto index : changed) {
+			ids.push_back(data.key_at(index));
+		}
+
+		SortedRange moved = NOTHING_MOVED;
+		for (auto id : ids) {
+			size_t i = data.index_of(id);
+			size_t start = i;
+			while (i > 0 && Less(data.value_at(i), data.value_at(i - 1))) {
+				data.swap_at(i, i - 1);
+				i--;
+			}
+			while (i + 1 < data.size() && Less(data.value_at(i + 1), data.value_at(i))) {
+				data.swap_at(i, i + 1);
+				i++;
+			}
+			if (i != start) {
+				moved.add(start);
+				moved.add(i);
+			}
+		}
+
+		// Unchanged neighbours are always in order with each other, so only the
+		// changed elements need checking. One can get stuck behind another changed
+		// element that hadn't been placed yet, which the timsort cleans up.
+		for (auto id : ids) {
+			size_t i = data.index_of(id);
+			bool out_of_order = (i > 0 && Less(data.value_at(i), data.value_at(i - 1)))
+				|| (i + 1 < data.size() && Less(data.value_at(i + 1), data.value_at(i)));
+			if (out_of_order) {
+				SortedRange rest = full_less_than_orderer<C, Less>(data);
+				if (!rest.empty()) {
+					moved.add(rest.first);
+					moved.add(rest.last - 1);
+				}
+				break;
+			}
+		}
+		return moved;
 	}
 
 	template <typename C>
@@ -46,7 +152,7 @@ namespace MattECS {
 
 	template <
 		typename C,
-		typename void(*Orderer)(std::vector<size_t>&, SparseHashmap<EntityID, C>&) = no_orderer<C>,
+		SortedRange(*Orderer)(const std::vector<size_t>&, SparseHashmap<EntityID, C>&) = no_orderer<C>,
 		typename void(*OnChange)(EntityID, const C&) = no_change_handler<C>
 	>
 	class ComponentContainer : public IComponentContainer {
@@ -72,7 +178,7 @@ namespace MattECS {
 			}
 		};
 
-		ComponentContainer(size_t entities) : _changed(false), _frame0(entities), _frame1(entities) {
+		ComponentContainer(size_t entities) : _changed(false), _structural(false), _moved(NOTHING_MOVED), _last_rebuilt(false), _last_moved(NOTHING_MOVED), _layout_version(0), _parallel(false), _parallel_sections(0), _history_first(0), _history_count(0), _restoring(false), _frame0(entities), _frame1(entities) {
 			_livedata = &_frame0;
 			_inprogress = &_frame1;
 			//_values.reserve(entities);
@@ -91,9 +197,42 @@ namespace MattECS {
 			return iterator(this, index);
 		}
 
+		// Binary search for the first element pred returns false for. This only makes
+		// sense when the Orderer keeps the container sorted in a way pred agrees with.
+		template <typename Pred>
+		iterator partition_point(Pred pred) {
+			size_t lo = 0;
+			size_t hi = _livedata->size();
+			while (lo < hi) {
+				size_t mid = lo + (hi - lo) / 2;
+				if (pred(_livedata->value_at(mid))) {
+					lo = mid + 1;
+				}
+				else {
+					hi = mid;
+				}
+			}
+			return iterator(this, lo);
+		}
+
 		bool has(EntityID id) const {
 			return _livedata->has(id);
 		}
+		size_t size() const {
+			return _livedata->size();
+		}
+		EntityID key_at(size_t index) const {
+			return _livedata->key_at(index);
+		}
+
+		// true if the element at index was added or mut()ed during the last frame.
+		bool changed(size_t index) const {
+			return index < _live_changed.size() && _live_changed[index];
+		}
+		// indices of the elements changed during the last frame, in no particular order.
+		const std::vector<size_t>& changed_indices() const {
+			return _live_changed_indices;
+		}
 
 		const C& cvalue(EntityID id) {
 			return _livedata->value_of(id);
@@ -127,6 +266,7 @@ namespace MattECS {
 			// this keeps the indices for the data to match inprogress
 			if (_inprogress->has(id)) {
 				_changed = true;
+				_structural = true;
 				_deleted_items.insert(id);
 			}
 		}
@@ -134,69 +274,387 @@ namespace MattECS {
 		void add_item(EntityID id, Args&&... args) {
 			if (!_inprogress->has(id)) {
 				_changed = true;
+				_structural = true;
+				size_t index = _inprogress->size();
 				_inprogress->emplace(id, std::forward<Args>(args)...);
+				set_changed(index);
 			}
 		}
 
 		void set_changed(size_t index) {
+			if (_parallel) {
+				// racing threads can only ever store the same flag.
+				std::atomic_ref<uint8_t> flag(_dirty[index]);
+				if (flag.load(std::memory_order_relaxed) == DIRTY_CLEAN) {
+					flag.store(DIRTY_UNLISTED, std::memory_order_relaxed);
+				}
+				return;
+			}
 			_changed = true;
-			//_dirty[index] = true;
+			if (index >= _dirty.size()) {
+				_dirty.resize(index + 1, DIRTY_CLEAN);
+			}
+			if (_dirty[index] == DIRTY_CLEAN) {
+				_dirty[index] = DIRTY_LISTED;
+				_dirty_indices.push_back(index);
+			}
+		}
+
+		// Between these set_changed may be called from several threads at once, as
+		// long as no two of them touch the same index. Nothing else may be called.
+		// Sections may overlap, systems running side by side can both par_each over
+		// a container they only read. The first one in sets up, the last one out
+		// lists what was flagged.
+		void begin_parallel() {
+			std::lock_guard<std::mutex> lock(_parallel_lock);
+			if (_parallel_sections++ > 0) {
+				return;
+			}
+			if (_dirty.size() < _inprogress->size()) {
+				_dirty.resize(_inprogress->size(), DIRTY_CLEAN);
+			}
+			_parallel = true;
+		}
+		void end_parallel() {
+			std::lock_guard<std::mutex> lock(_parallel_lock);
+			assert(_parallel_sections > 0);
+			if (--_parallel_sections > 0) {
+				return;
+			}
+			_parallel = false;
+			// index order, so the result doesn't depend on how the threads ran.
+			for (size_t index = 0; index < _dirty.size(); index++) {
+				if (_dirty[index] == DIRTY_UNLISTED) {
+					_dirty[index] = DIRTY_LISTED;
+					_dirty_indices.push_back(index);
+					_changed = true;
+				}
+			}
 		}
 
 		virtual void end_frame() {
+			if (!_history.empty() && !_restoring) {
+				_record_history();
+			}
+
+			// removes and sorts can move elements, so remember what changed by id too.
+			for (auto index : _dirty_indices) {
+				_changed_ids.push_back(_inprogress->key_at(index));
+			}
+
+			// removing swaps the last element into the hole, so it is out of place too.
+			std::vector<EntityID> swapped_ids;
 			for (auto id : _deleted_items) {
+				EntityID last = _inprogress->key_at(_inprogress->size() - 1);
+				if (last != id) {
+					swapped_ids.push_back(last);
+				}
 				_inprogress->remove(id);
 			}
 			_deleted_items.clear();
 
 			if (_changed) {
-				//if constexpr (OnChange != no_change_handler) {
-				//	for (size_t i = 0; i < _dirty.size(); i++) {
-				//		_dirty[i] = false;
-				//		OnChange(_ids[i], _values.at(i));
-				//	}
-				//}
-				if constexpr (Orderer != no_orderer) {
-					_sort();
+				if constexpr (Orderer != no_orderer<C>) {
+					_sort(swapped_ids);
 				}
 				_changed = false;
 			}
-			if (_livedata == &_frame0) {
-				// frame 1 is going to become the current
-				// and we clone frame 1 to frame0 for updates.
-				_frame0 = _frame1;
-				_livedata = &_frame1;
-				_inprogress = &_frame0;
-			} else {
-				_frame1 = _frame0;
-				_livedata = &_frame0;
-				_inprogress = &_frame1;
+
+			// the in progress frame becomes the current one, and the old current
+			// frame is brought up to date to become the next in progress frame.
+			std::swap(_livedata, _inprogress);
+			if (_structural) {
+				// adds and removes change the size, so just clone.
+				*_inprogress = *_livedata;
+			}
+			else {
+				// both frames share a layout apart from what the sort moved, and
+				// only the elements mut()ed differ.
+				if (!_moved.empty()) {
+					_inprogress->copy_range(*_livedata, _moved.first, _moved.last);
+				}
+				for (auto index : _dirty_indices) {
+					_inprogress->value_at(index) = _livedata->value_at(index);
+				}
+			}
+
+			_mark_live_changed();
+
+			for (auto index : _dirty_indices) {
+				_dirty[index] = DIRTY_CLEAN;
+			}
+			_dirty_indices.clear();
+			_changed_ids.clear();
+			if (_structural || !_moved.empty()) {
+				_last_rebuilt = _structural;
+				_last_moved = _moved;
+				_layout_version++;
+			}
+			_structural = false;
+			_moved = NOTHING_MOVED;
+
+			if constexpr (OnChange != no_change_handler<C>) {
+				for (auto index : _live_changed_indices) {
+					OnChange(_livedata->key_at(index), _livedata->value_at(index));
+				}
 			}
 		}
 
 		virtual void update_all() {
 		}
 
+		virtual std::optional<size_t> index_of(EntityID id) const {
+			return _livedata->find_index_of(id);
+		}
+		virtual size_t entity_count() const {
+			return _livedata->size();
+		}
+		virtual EntityID entity_at(size_t index) const {
+			return _livedata->key_at(index);
+		}
+		virtual size_t layout_version() const {
+			return _layout_version;
+		}
+		virtual bool layout_rebuilt() const {
+			return _last_rebuilt;
+		}
+		virtual SortedRange layout_moved() const {
+			return _last_moved;
+		}
+
+		virtual void set_history(size_t ticks) {
+			_history.clear();
+			_history.resize(ticks);
+			_history_first = 0;
+			_history_count = 0;
+		}
+
+		// The element as it was ticks end_frames ago, nothing if the entity didn't
+		// have it back then.
+		std::optional<const C*> find_past(EntityID id, size_t ticks) {
+			assert(ticks <= _history_count);
+			// the oldest delta the element shows up in has what it was back then.
+			for (size_t back = ticks; back > 0; back--) {
+				const HistoryDelta& delta = _history_delta(back - 1);
+				auto it = std::lower_bound(delta.ids.begin(), delta.ids.end(), id);
+				if (it != delta.ids.end() && *it == id) {
+					const std::optional<C>& before = delta.before[it - delta.ids.begin()];
+					if (!before) {
+						return {};
+					}
+					return &before.value();
+				}
+			}
+			auto index = _livedata->find_index_of(id);
+			if (!index) {
+				return {};
+			}
+			return &_livedata->value_at(index.value());
+		}
+
+		// Values and membership come back as they were, the order of the elements
+		// may not. Restored elements count as changed during the rewind's frame.
+		virtual void rewind(size_t ticks, std::vector<EntityID>& touched) {
+			assert(ticks <= _history_count);
+			assert(!_parallel);
+
+			// forget the frame in progress.
+			for (auto index : _dirty_indices) {
+				_dirty[index] = DIRTY_CLEAN;
+			}
+			_dirty_indices.clear();
+			for (auto id : _deleted_items) {
+				touched.push_back(id);
+			}
+			_deleted_items.clear();
+			for (size_t i = _livedata->size(); i < _inprogress->size(); i++) {
+				touched.push_back(_inprogress->key_at(i));
+			}
+			*_inprogress = *_livedata;
+			_changed = false;
+			_structural = false;
+
+			std::unordered_set<EntityID> restored;
+			std::vector<std::pair<EntityID, const std::optional<C>*>> targets;
+			for (size_t back = ticks; back > 0; back--) {
+				const HistoryDelta& delta = _history_delta(back - 1);
+				for (size_t i = 0; i < delta.ids.size(); i++) {
+					if (restored.insert(delta.ids[i]).second) {
+						targets.emplace_back(delta.ids[i], &delta.before[i]);
+					}
+				}
+			}
+
+			// removes go through first, an entity coming back may need the slot
+			// a newer entity still holds.
+			for (auto& target : targets) {
+				if (!*target.second && _inprogress->has(target.first)) {
+					delete_item(target.first);
+					touched.push_back(target.first);
+				}
+			}
+			if (_structural) {
+				_restoring = true;
+				end_frame();
+				_restoring = false;
+			}
+			for (auto& target : targets) {
+				const std::optional<C>& before = *target.second;
+				if (!before) {
+					continue;
+				}
+				if (_inprogress->has(target.first)) {
+					value(target.first) = before.value();
+				}
+				else {
+					add_item(target.first, before.value());
+					touched.push_back(target.first);
+				}
+			}
+			_history_count -= ticks;
+
+			// committed like any other frame, just not recorded as one.
+			_restoring = true;
+			end_frame();
+			_restoring = false;
+		}
+
 	private:
-		void _sort() {
-			std::vector<size_t> indices(_inprogress->size());
-			for (size_t i = 0; i < _inprogress->size(); i++) {
-				indices[i] = i;
+		static constexpr uint8_t DIRTY_CLEAN = 0;
+		static constexpr uint8_t DIRTY_LISTED = 1;
+		// flagged during a parallel section, not in _dirty_indices yet.
+		static constexpr uint8_t DIRTY_UNLISTED = 2;
+
+		// What undoing one end_frame takes: the value each element it changed,
+		// added or removed had before, nothing for the ones it added. Sorted by id.
+		struct HistoryDelta {
+			std::vector<EntityID> ids;
+			std::vector<std::optional<C>> before;
+		};
+
+		// the ith newest delta.
+		const HistoryDelta& _history_delta(size_t i) const {
+			return _history[(_history_first + _history_count - 1 - i) % _history.size()];
+		}
+
+		// Runs before the frame is committed, while _livedata still has the old values.
+		void _record_history() {
+			HistoryDelta* delta;
+			if (_history_count < _history.size()) {
+				delta = &_history[(_history_first + _history_count) % _history.size()];
+				_history_count++;
+			}
+			else {
+				// full, the oldest delta gets reused.
+				delta = &_history[_history_first];
+				_history_first = (_history_first + 1) % _history.size();
+			}
+
+			delta->ids.clear();
+			delta->before.clear();
+			for (auto index : _dirty_indices) {
+				delta->ids.push_back(_inprogress->key_at(index));
+			}
+			for (auto id : _deleted_items) {
+				delta->ids.push_back(id);
+			}
+			std::sort(delta->ids.begin(), delta->ids.end());
+			delta->ids.erase(std::unique(delta->ids.begin(), delta->ids.end()), delta->ids.end());
+			for (auto id : delta->ids) {
+				auto index = _livedata->find_index_of(id);
+				if (index) {
+					delta->before.emplace_back(_livedata->value_at(index.value()));
+				}
+				else {
+					delta->before.emplace_back();
+				}
+			}
+		}
+
+		// moves this frame's dirty elements over to the indices they have in _livedata.
+		void _mark_live_changed() {
+			for (auto index : _live_changed_indices) {
+				if (index < _live_changed.size()) {
+					_live_changed[index] = false;
+				}
+			}
+			_live_changed_indices.clear();
+
+			if (_structural || !_moved.empty()) {
+				for (auto id : _changed_ids) {
+					auto index = _livedata->find_index_of(id);
+					if (index) {
+						_live_changed_indices.push_back(index.value());
+					}
+				}
+			}
+			else {
+				_live_changed_indices = _dirty_indices;
+			}
+
+			if (_live_changed.size() < _livedata->size()) {
+				_live_changed.resize(_livedata->size(), false);
 			}
-			if constexpr (Orderer != no_orderer) {
-				Orderer(indices, *_inprogress);
+			for (auto index : _live_changed_indices) {
+				_live_changed[index] = true;
 			}
-			_inprogress->apply_sort(indices);
+		}
+
+		void _sort(const std::vector<EntityID>& swapped_ids) {
+			if (!_structural) {
+				_moved = Orderer(_dirty_indices, *_inprogress);
+				return;
+			}
+			// adds and removes shuffled the indices, find everything out of place again.
+			std::vector<size_t> changed;
+			for (auto id : _changed_ids) {
+				auto index = _inprogress->find_index_of(id);
+				if (index) {
+					changed.push_back(index.value());
+				}
+			}
+			for (auto id : swapped_ids) {
+				auto index = _inprogress->find_index_of(id);
+				if (index) {
+					changed.push_back(index.value());
+				}
+			}
+			_moved = Orderer(changed, *_inprogress);
 		}
 
 		// _changed is set if any are dirty
 		bool _changed;
+		// set when an add or remove changed the layout of _inprogress.
+		bool _structural;
+		// what the last sort moved around.
+		SortedRange _moved;
+		// _structural and _moved as of the last end_frame that changed the layout.
+		bool _last_rebuilt;
+		SortedRange _last_moved;
+		size_t _layout_version;
+		// inside begin_parallel/end_parallel.
+		bool _parallel;
+		// how many par_each are inside at once, guarded by _parallel_lock.
+		size_t _parallel_sections;
+		std::mutex _parallel_lock;
 
 		// track which elements changed or at least what mut()s were called.
-		//std::vector<bool> _dirty;
-		// next step: we want a circular buffer of these for frames.
-		// if we want a rewind up to 8 fixedupdate frames, we need 8 sparsemaps.
-		// then we need a way to query/view a very specific frame, but default to latest.
+		// one of the DIRTY_ flags per index.
+		std::vector<uint8_t> _dirty;
+		std::vector<size_t> _dirty_indices;
+		// ids of the dirty elements, for when the layout changes.
+		std::vector<EntityID> _changed_ids;
+		// the dirty elements of the last frame, indexed like _livedata.
+		std::vector<bool> _live_changed;
+		std::vector<size_t> _live_changed_indices;
+		// ring of undo deltas for the last end_frames, empty if history is off.
+		// _history_first is the oldest of the _history_count in use.
+		std::vector<HistoryDelta> _history;
+		size_t _history_first;
+		size_t _history_count;
+		// inside rewind, whose end_frame isn't recorded.
+		bool _restoring;
+
 		SparseHashmap<EntityID, C> _frame0;
 		SparseHashmap<EntityID, C> _frame1;
 		SparseHashmap<EntityID, C>* _livedata;
@@ -3,6 +3,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 
 #include <SFML/Graphics.hpp>
@@ -28,6 +29,25 @@ struct LimitedLifetime {
 	LimitedLifetime(int f) : frames(f) {}
 };
 
+// Throws a falling, animated sprite up every rate ticks, fanning them out
+// left and right. The particles have no AABB so they never collide.
+struct ParticleSpawner {
+	sf::Texture* texture;
+	SpriteSheetEntryConfig* config;
+	int animation_id;
+	int z_index;
+	int rate;
+	int lifetime;
+	float speed;
+	// ticks until the next particle
+	int countdown;
+	unsigned int spawned;
+
+	ParticleSpawner() : texture(nullptr), config(nullptr), animation_id(-1), z_index(0), rate(1), lifetime(1), speed(0.0f), countdown(1), spawned(0) {}
+	ParticleSpawner(sf::Texture* t, SpriteSheetEntryConfig* c, int id, int z, int r, int l, float s) :
+		texture(t), config(c), animation_id(id), z_index(z), rate(r), lifetime(l), speed(s), countdown(r), spawned(0) {}
+};
+
 struct Sprite {
 	sf::Texture* t;
 	sf::Vertex va[4];
@@ -126,16 +146,13 @@ struct AABB {
 	// for rendering:
 	// if a collision is currently happening
 	bool collision = false;
-	sf::RectangleShape render_box;
-
-	AABB() : size(0.0f, 0.0f), previous_position(0.0f, 0.0f), previous_velocity(0.0f, 0.0f), render_box(), material(Material::Permeable), damage(0), hardness(0), piercing(0) {}
-	AABB(sf::Vector2f s, Material m, int d = 0, int h = 0, int p = 0) : size(s), previous_position(0.0f, 0.0f), previous_velocity(0.0f, 0.0f), render_box(s), material(m), damage(d), hardness(h), piercing(p) {
-		half_size = sf::Vector2f(s.x / 2.0f, s.y / 2.0f);
-		render_box.setOrigin(half_size.x, half_size.y);
-		render_box.setFillColor(sf::Color::Transparent);
-		render_box.setOutlineThickness(1.0f);
-	}
+
+	AABB() : size(0.0f, 0.0f), half_size(0.0f, 0.0f), previous_position(0.0f, 0.0f), previous_velocity(0.0f, 0.0f), material(Material::Permeable), damage(0), hardness(0), piercing(0) {}
+	AABB(sf::Vector2f s, Material m, int d = 0, int h = 0, int p = 0) : size(s), half_size(s.x / 2.0f, s.y / 2.0f), previous_position(0.0f, 0.0f), previous_velocity(0.0f, 0.0f), material(m), damage(d), hardness(h), piercing(p) {}
 };
+// The collision loops walk these every tick, keep them plain data. Debug drawing
+// lives in the scene, not in the component.
+static_assert(std::is_trivially_copyable<Transform>::value && std::is_trivially_copyable<Movement>::value && std::is_trivially_copyable<AABB>::value, "hot physics components should stay plain data");
 
 struct Sensors {
 	bool left;
@@ -0,0 +1,236 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MicroBenchmark.h"
+
+#include "ComponentContainer.h"
+#include "EntityManager.h"
+#include "SparseHashmap.h"
+
+// Micro-benchmarks of the ECS storage and queries, for comparing changes to
+// them. Every benchmark runs at 100 to 100k entities, and the storage ones at
+// several component sizes. Run with --benchmark_format=json (or csv) or
+// --benchmark_out=<file> for results to diff.
+
+namespace {
+	const int64_t ENTITY_COUNTS[] = { 100, 1000, 10000, 100000 };
+	// percent of the components changed every frame.
+	const int64_t DIRTY_PERCENTS[] = { 0, 10, 100 };
+
+	// A component of Bytes bytes. Only value is ever read or written, the rest
+	// is there to spread the components out in memory. Tag makes distinct types
+	// of the same size for the queries.
+	template <size_t Bytes, int Tag = 0>
+	struct Payload {
+		static_assert(Bytes > sizeof(uint32_t), "Payload needs room for its value");
+		uint32_t value;
+		uint8_t padding[Bytes - sizeof(uint32_t)];
+
+		Payload() : value(0), padding() {}
+		Payload(uint32_t v) : value(v), padding() {}
+	};
+
+	// 0..n-1 in an order that is the same every run.
+	std::vector<MattECS::EntityID> shuffled(size_t n) {
+		std::vector<MattECS::EntityID> ids(n);
+		for (size_t i = 0; i < n; i++) {
+			ids[i] = i;
+		}
+		std::mt19937 rng(0);
+		for (size_t i = n - 1; i > 0; i--) {
+			std::swap(ids[i], ids[rng() % (i + 1)]);
+		}
+		return ids;
+	}
+
+	template <size_t Bytes>
+	SparseHashmap<MattECS::EntityID, Payload<Bytes>> filled_map(size_t n) {
+		SparseHashmap<MattECS::EntityID, Payload<Bytes>> map(n);
+		for (MattECS::EntityID id = 0; id < n; id++) {
+			Payload<Bytes> p((uint32_t)id);
+			map.add(id, p);
+		}
+		return map;
+	}
+
+	// Removes an entity and adds it straight back, so the map stays the same size
+	// but its order keeps getting shuffled by the swap and pop.
+	template <size_t Bytes>
+	void SparseHashmapChurn(benchmark::State& state) {
+		size_t n = (size_t)state.range(0);
+		auto map = filled_map<Bytes>(n);
+		auto ids = shuffled(n);
+
+		size_t next = 0;
+		for (auto _ : state) {
+			MattECS::EntityID id = ids[next];
+			map.remove(id);
+			Payload<Bytes> p((uint32_t)id);
+			map.add(id, p);
+			next = next + 1 < n ? next + 1 : 0;
+		}
+		size_t size = map.size();
+		benchmark::DoNotOptimize(size);
+		state.SetItemsProcessed((int64_t)state.iterations());
+	}
+
+	// Looks up entities in no particular order and reads their component.
+	template <size_t Bytes>
+	void SparseHashmapFind(benchmark::State& state) {
+		size_t n = (size_t)state.range(0);
+		auto map = filled_map<Bytes>(n);
+		auto ids = shuffled(n);
+
+		size_t next = 0;
+		uint32_t sum = 0;
+		for (auto _ : state) {
+			auto index = map.find_index_of(ids[next]);
+			sum += map.value_at(index.value()).value;
+			next = next + 1 < n ? next + 1 : 0;
+		}
+		benchmark::DoNotOptimize(sum);
+		state.SetItemsProcessed((int64_t)state.iterations());
+	}
+
+	// Reorders every element, alternating a shuffle and the shuffle that undoes
+	// it so each iteration moves everything without any untimed setup.
+	template <size_t Bytes>
+	void SparseHashmapApplySort(benchmark::State& state) {
+		size_t n = (size_t)state.range(0);
+		auto map = filled_map<Bytes>(n);
+
+		std::vector<size_t> forward(n);
+		auto ids = shuffled(n);
+		for (size_t i = 0; i < n; i++) {
+			forward[i] = ids[i];
+		}
+		std::vector<size_t> backward(n);
+		for (size_t i = 0; i < n; i++) {
+			backward[forward[i]] = i;
+		}
+
+		bool flip = false;
+		for (auto _ : state) {
+			map.apply_sort(flip ? backward : forward);
+			flip = !flip;
+		}
+		MattECS::EntityID first = map.key_at(0);
+		benchmark::DoNotOptimize(first);
+		state.SetItemsProcessed((int64_t)(state.iterations() * n));
+		state.SetBytesProcessed((int64_t)(state.iterations() * n * sizeof(Payload<Bytes>)));
+	}
+
+	// Changes a share of the components then ends the frame, which copies them
+	// over to the live data. At 0% this is what an idle container costs.
+	template <size_t Bytes>
+	void ComponentContainerEndFrame(benchmark::State& state) {
+		size_t n = (size_t)state.range(0);
+		size_t dirty = n * (size_t)state.range(1) / 100;
+
+		MattECS::ComponentContainer<Payload<Bytes>> container(n);
+		for (MattECS::EntityID id = 0; id < n; id++) {
+			container.add_item(id, (uint32_t)id);
+		}
+		container.end_frame();
+		auto ids = shuffled(n);
+
+		for (auto _ : state) {
+			for (size_t i = 0; i < dirty; i++) {
+				container.value(ids[i]).value++;
+			}
+			container.end_frame();
+		}
+		uint32_t first = container.cvalue(0).value;
+		benchmark::DoNotOptimize(first);
+		state.SetItemsProcessed((int64_t)(state.iterations() * n));
+		state.SetBytesProcessed((int64_t)(state.iterations() * dirty * sizeof(Payload<Bytes>)));
+	}
+
+	// Walks a query over the first Cs of four components every entity has,
+	// reading each of them.
+	template <size_t Bytes, typename... Cs>
+	void Query(benchmark::State& state) {
+		size_t n = (size_t)state.range(0);
+
+		MattECS::EntityManager em;
+		em.register_component<Payload<Bytes, 0>>();
+		em.register_component<Payload<Bytes, 1>>();
+		em.register_component<Payload<Bytes, 2>>();
+		em.register_component<Payload<Bytes, 3>>();
+		for (size_t i = 0; i < n; i++) {
+			auto e = em.entity();
+			em.add<Payload<Bytes, 0>>(e, (uint32_t)i);
+			em.add<Payload<Bytes, 1>>(e, (uint32_t)i);
+			em.add<Payload<Bytes, 2>>(e, (uint32_t)i);
+			em.add<Payload<Bytes, 3>>(e, (uint32_t)i);
+		}
+		em.end_frame();
+
+		uint32_t sum = 0;
+		for (auto _ : state) {
+			auto q = em.query<Cs...>();
+			for (auto it = q.begin(); it != q.end(); ++it) {
+				sum += (it.template value<Cs>().value + ...);
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+		state.SetItemsProcessed((int64_t)(state.iterations() * n));
+	}
+
+	// Google Benchmark's names take a const char* in older versions.
+	template <typename Fn>
+	auto add(const std::string& name, Fn* fn) {
+		return benchmark::RegisterBenchmark(name.c_str(), fn);
+	}
+
+	template <size_t Bytes>
+	void register_storage() {
+		std::string size = "<" + std::to_string(Bytes) + ">";
+		auto churn = add("SparseHashmap/churn" + size, SparseHashmapChurn<Bytes>);
+		auto find = add("SparseHashmap/find" + size, SparseHashmapFind<Bytes>);
+		auto sort = add("SparseHashmap/apply_sort" + size, SparseHashmapApplySort<Bytes>);
+		auto end_frame = add("ComponentContainer/end_frame" + size, ComponentContainerEndFrame<Bytes>);
+		for (auto n : ENTITY_COUNTS) {
+			churn->Arg(n);
+			find->Arg(n);
+			sort->Arg(n)->Unit(benchmark::kMicrosecond);
+			for (auto percent : DIRTY_PERCENTS) {
+				end_frame->Args({ n, percent })->Unit(benchmark::kMicrosecond);
+			}
+		}
+	}
+
+	template <size_t Bytes>
+	void register_queries() {
+		std::string size = "<" + std::to_string(Bytes) + ">";
+		auto queries = {
+			add("Query/1" + size, Query<Bytes, Payload<Bytes, 0>>),
+			add("Query/2" + size, Query<Bytes, Payload<Bytes, 0>, Payload<Bytes, 1>>),
+			add("Query/3" + size, Query<Bytes, Payload<Bytes, 0>, Payload<Bytes, 1>, Payload<Bytes, 2>>),
+			add("Query/4" + size, Query<Bytes, Payload<Bytes, 0>, Payload<Bytes, 1>, Payload<Bytes, 2>, Payload<Bytes, 3>>),
+		};
+		for (auto q : queries) {
+			for (auto n : ENTITY_COUNTS) {
+				q->Arg(n)->Unit(benchmark::kMicrosecond);
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	register_storage<8>();
+	register_storage<64>();
+	register_storage<256>();
+	register_queries<8>();
+	register_queries<64>();
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
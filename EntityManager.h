@@ -1,22 +1,61 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <iostream>
 #include <functional>
 #include <optional>
 #include <tuple>
-#include <typeindex>
-#include <typeinfo> 
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "ArchetypeIndex.h"
 #include "ComponentContainer.h"
+#include "ThreadPool.h"
 
 namespace MattECS {
 	typedef size_t EntityID;
 	const size_t MAX_ENTITIES = 10000;
 
+	// An EntityID is a slot in the low ENTITY_SLOT_BITS and how many times that
+	// slot has been handed out before in the rest. Slots are reused once an entity
+	// is removed, the generation is what tells an old id apart from the new one.
+	// With a 32 bit size_t that leaves 12 bits, so a slot's generation wraps after
+	// it has been reused 4096 times.
+	const size_t ENTITY_SLOT_BITS = SPARSE_SLOT_BITS;
+	const size_t ENTITY_GENERATION_MASK = SIZE_MAX >> ENTITY_SLOT_BITS;
+	static_assert(ENTITY_SLOT_BITS < sizeof(EntityID) * 8, "an EntityID needs bits for its generation");
+	static_assert(MAX_ENTITIES <= SPARSE_SLOT_MASK + 1, "every entity needs a slot of its own");
+
+	inline size_t entity_slot(EntityID id) {
+		return id & SPARSE_SLOT_MASK;
+	}
+	inline size_t entity_generation(EntityID id) {
+		return id >> ENTITY_SLOT_BITS;
+	}
+	inline EntityID make_entity_id(size_t slot, size_t generation) {
+		return ((generation & ENTITY_GENERATION_MASK) << ENTITY_SLOT_BITS) | slot;
+	}
+
+	// Component ids are handed out once per type, the first time the type is seen,
+	// and shared by every EntityManager. Looking one up is just reading a constant.
+	// how many of those ids have been handed out so far.
+	inline size_t& component_type_count() {
+		static size_t count = 0;
+		return count;
+	}
+	inline size_t next_component_type_id() {
+		return component_type_count()++;
+	}
+	template <typename C>
+	inline const size_t component_type_id = next_component_type_id();
+
+	// Entities per par_each job. Big enough to be worth handing to another thread,
+	// small enough that a chunk's components stay in cache.
+	const size_t PAR_EACH_CHUNK = 1024;
+
 	class EntityManager {
 	public:
 		template <typename CFirst, typename... COthers>
@@ -24,12 +63,37 @@ namespace MattECS {
 		public:
 			class iterator {
 			public:
-				iterator(ComponentContainer<CFirst>::iterator it, ComponentContainer<CFirst>::iterator end, std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...>& cmanagers, bool is_optional[1 + sizeof...(COthers)]) : _it(it), _end(end), _cmanagers(cmanagers) {
-					for (unsigned int i = 1; i < sizeof...(COthers) + 1; i++) {
+				iterator(ComponentContainer<CFirst>::iterator it, ComponentContainer<CFirst>::iterator end, std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...>& cmanagers, bool is_optional[1 + sizeof...(COthers)], bool only_changed[1 + sizeof...(COthers)]) : _it(it), _end(end), _cmanagers(cmanagers) {
+					for (unsigned int i = 0; i < sizeof...(COthers) + 1; i++) {
+						_is_optional[i] = is_optional[i];
+						_only_changed[i] = only_changed[i];
+					}
+					_set_values(std::index_sequence_for<CFirst, COthers...>{});
+					if (!_has_all && !_at_end()) {
+						_next();
+					}
+				}
+				// Walks [first, last) of the container of component driver instead of CFirst's, probing the rest.
+				iterator(ComponentContainer<CFirst>::iterator end, std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...>& cmanagers, bool is_optional[1 + sizeof...(COthers)], bool only_changed[1 + sizeof...(COthers)], size_t driver, size_t first, size_t last) : _it(end), _end(end), _cmanagers(cmanagers), _driver(driver), _pos(first), _count(last) {
+					for (unsigned int i = 0; i < sizeof...(COthers) + 1; i++) {
+						_is_optional[i] = is_optional[i];
+						_only_changed[i] = only_changed[i];
+					}
+					_set_values(std::index_sequence_for<CFirst, COthers...>{});
+					if (!_has_all && !_at_end()) {
+						_next();
+					}
+				}
+				// Walks the archetype tables that have every required component instead.
+				iterator(ComponentContainer<CFirst>::iterator end, std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...>& cmanagers, bool is_optional[1 + sizeof...(COthers)], bool only_changed[1 + sizeof...(COthers)], const std::vector<Archetype>* tables, size_t table, ComponentMask required, const size_t cids[1 + sizeof...(COthers)]) : _it(end), _end(end), _cmanagers(cmanagers), _tables(tables), _table(table), _row(0), _required(required) {
+					for (unsigned int i = 0; i < sizeof...(COthers) + 1; i++) {
 						_is_optional[i] = is_optional[i];
+						_only_changed[i] = only_changed[i];
+						_cids[i] = cids[i];
 					}
-					_set_values(std::index_sequence_for<COthers...>{});
-					if (!_has_all && _it != _end) {
+					_skip_tables();
+					_set_table_values(std::index_sequence_for<CFirst, COthers...>{});
+					if (!_has_all && !_at_end()) {
 						_next();
 					}
 				}
@@ -40,10 +104,29 @@ namespace MattECS {
 					return *this;
 				}
 
-				bool operator==(iterator other) const { return _it == other._it; }
-				bool operator!=(iterator other) const { return _it != other._it; }
+				bool operator==(iterator other) const {
+					if (_at_end() || other._at_end()) {
+						return _at_end() && other._at_end();
+					}
+					if (_tables != nullptr || other._tables != nullptr) {
+						return _tables == other._tables && _table == other._table && _row == other._row;
+					}
+					if (_driver != other._driver) {
+						return false;
+					}
+					if (_driver != 0) {
+						return _pos == other._pos;
+					}
+					return _it == other._it;
+				}
+				bool operator!=(iterator other) const { return !(*this == other); }
 
-				EntityID entity() const { return _it.entity(); }
+				EntityID entity() const {
+					if (_tables != nullptr) {
+						return (*_tables)[_table].entities[_row];
+					}
+					return _entity;
+				}
 
 				// C++ accessors by type
 				template <typename C>
@@ -81,28 +164,93 @@ namespace MattECS {
 				}
 			private:
 				void _next() {
+					if (_tables != nullptr) {
+						do {
+							_row++;
+							_skip_tables();
+							_set_table_values(std::index_sequence_for<CFirst, COthers...>{});
+						} while (!_has_all && !_at_end());
+						return;
+					}
 					do {
-						++_it;
-						_set_values(std::index_sequence_for<COthers...>{});
-					} while (!_has_all && _it != _end);
+						if (_driver != 0) {
+							++_pos;
+						}
+						else {
+							++_it;
+						}
+						_set_values(std::index_sequence_for<CFirst, COthers...>{});
+					} while (!_has_all && !_at_end());
+				}
+				bool _at_end() const {
+					if (_tables != nullptr) {
+						return _table >= _tables->size();
+					}
+					if (_driver != 0) {
+						return _pos >= _count;
+					}
+					return _it == _end;
+				}
+				// moves on to the next table with rows and every required component.
+				void _skip_tables() {
+					while (_table < _tables->size()) {
+						const Archetype& a = (*_tables)[_table];
+						if (_row < a.size() && (a.mask & _required) == _required) {
+							return;
+						}
+						_table++;
+						_row = 0;
+					}
+				}
+				template <std::size_t... Is>
+				void _set_table_values(std::index_sequence<Is...>) {
+					if (_at_end()) {
+						return;
+					}
+					const Archetype& a = (*_tables)[_table];
+					((_indices[Is] = a.has(_cids[Is]) ? std::optional<size_t>(a.columns[_cids[Is]][_row]) : std::optional<size_t>()), ...);
+					_has_all = ((!_only_changed[Is] || (_indices[Is] && std::get<Is>(_cmanagers)->changed(_indices[Is].value()))) && ...);
 				}
 				template <std::size_t... Is>
 				void _set_values(std::index_sequence<Is...>) {
-					if (_it == _end) {
+					if (_at_end()) {
 						return;
 					}
-					auto id = _it.entity();
-					_indices[0] = _it.index();
-					((_indices[Is+1] = std::get<ComponentContainer<COthers>*>(_cmanagers)->find(id).index()), ...);
-					_has_all = ((_is_optional[Is+1] || _indices[Is+1]) && ...);
+					if (_driver == 0) {
+						_entity = _it.entity();
+						_indices[0] = _it.index();
+					}
+					else {
+						((Is == _driver ? (_entity = std::get<Is>(_cmanagers)->key_at(_pos), true) : false) || ...);
+						_indices[_driver] = _pos;
+					}
+					((_indices[Is] = (Is == _driver) ? _indices[Is] : std::get<Is>(_cmanagers)->find(_entity).index()), ...);
+					// CFirst can't be optional.
+					_has_all = ((_indices[Is] || (Is != 0 && _is_optional[Is])) && ...)
+						&& ((!_only_changed[Is] || (_indices[Is] && std::get<Is>(_cmanagers)->changed(_indices[Is].value()))) && ...);
 				}
 				bool _has_all;
 				std::optional<size_t> _indices[1 + sizeof...(COthers)];
 				ComponentContainer<CFirst>::iterator _it;
 				ComponentContainer<CFirst>::iterator _end;
 				bool _is_optional[1 + sizeof...(COthers)];
+				bool _only_changed[1 + sizeof...(COthers)];
 				std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...>& _cmanagers;
 
+				EntityID _entity = 0;
+				// the component whose container is walked when it isn't CFirst.
+				size_t _driver = 0;
+				size_t _pos = 0;
+				// where _pos stops.
+				size_t _count = 0;
+
+				// only set when walking archetype tables.
+				const std::vector<Archetype>* _tables = nullptr;
+				size_t _table = 0;
+				size_t _row = 0;
+				ComponentMask _required = 0;
+				size_t _cids[1 + sizeof...(COthers)];
+
 				template<typename CT, typename CH, typename... CR>
 				constexpr size_t _cindex() {
 					if constexpr (std::is_same<CT, CH>::value) {
@@ -116,9 +264,11 @@ namespace MattECS {
 				}
 			};
 
-			Querier(std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...> managers) : _cmanagers(managers) {
+			Querier(std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...> managers, const ArchetypeIndex* archetypes, const size_t cids[1 + sizeof...(COthers)]) : _cmanagers(managers), _archetypes(archetypes), _grouped(false) {
 				for (size_t i = 0; i < 1 + sizeof...(COthers); ++i) {
 					_is_optional[i] = false;
+					_only_changed[i] = false;
+					_cids[i] = cids[i];
 				}
 			}
 
@@ -129,22 +279,124 @@ namespace MattECS {
 				_is_optional[_cindex<C, CFirst, COthers...>()] = true;
 				return *this;
 			}
+			// Only visit entities whose C was added or mut()ed during the last frame.
+			template <typename C = CFirst>
+			Querier& changed() {
+				_only_changed[_cindex<C, CFirst, COthers...>()] = true;
+				return *this;
+			}
+			// Iterate table by table over the archetypes that match instead of probing
+			// every other container per entity. The order is by archetype, not by
+			// CFirst's Orderer. Needs EntityManager::enable_archetypes().
+			Querier& grouped() {
+				assert(_archetypes != nullptr);
+				_grouped = true;
+				return *this;
+			}
 
+			// Walks whichever required component has the fewest entities and probes the
+			// rest, so the order follows that container. find() and partition_point()
+			// always go by CFirst.
 			iterator begin() {
 				auto cm = std::get<ComponentContainer<CFirst>*>(_cmanagers);
-				return iterator(cm->begin(), cm->end(), _cmanagers, _is_optional);
+				if (_grouped) {
+					return iterator(cm->end(), _cmanagers, _is_optional, _only_changed, &_archetypes->tables(), 0, _required(), _cids);
+				}
+				size_t count;
+				size_t driver = _pick_driver(count);
+				return _range(driver, 0, count);
 			}
 			iterator end() {
 				auto cm = std::get<ComponentContainer<CFirst>*>(_cmanagers);
-				return iterator(cm->end(), cm->end(), _cmanagers, _is_optional);
+				if (_grouped) {
+					return iterator(cm->end(), _cmanagers, _is_optional, _only_changed, &_archetypes->tables(), _archetypes->tables().size(), _required(), _cids);
+				}
+				return iterator(cm->end(), cm->end(), _cmanagers, _is_optional, _only_changed);
 			}
 			iterator find(EntityID id) {
 				auto cm = std::get<ComponentContainer<CFirst>*>(_cmanagers);
-				return iterator(cm->find(id), cm->end(), _cmanagers, _is_optional);
+				return iterator(cm->find(id), cm->end(), _cmanagers, _is_optional, _only_changed);
+			}
+			// Starts at the first CFirst pred returns false for, see ComponentContainer::partition_point.
+			template <typename Pred>
+			iterator partition_point(Pred pred) {
+				auto cm = std::get<ComponentContainer<CFirst>*>(_cmanagers);
+				return iterator(cm->partition_point(pred), cm->end(), _cmanagers, _is_optional, _only_changed);
+			}
+
+			// Calls f(iterator&) for every entity begin() would visit, with the driving
+			// container cut into chunks that run on the shared ThreadPool. f runs on
+			// several threads at once, so it may only write through the iterator's mut().
+			// Each entity is visited once, those writes never overlap. Two par_each may
+			// share a container, but only one of them may write to it.
+			// Not for grouped() queries.
+			template <typename F>
+			void par_each(F&& f, size_t chunk = PAR_EACH_CHUNK) {
+				assert(!_grouped);
+				size_t count;
+				size_t driver = _pick_driver(count);
+				auto run = [this, &f, driver](size_t first, size_t last) {
+					auto end = _range(driver, last, last);
+					for (auto it = _range(driver, first, last); it != end; ++it) {
+						f(it);
+					}
+				};
+				if (count <= chunk) {
+					run(0, count);
+					return;
+				}
+
+				std::apply([](auto... cm) { (cm->begin_parallel(), ...); }, _cmanagers);
+				ThreadPool::Group group;
+				for (size_t first = 0; first < count; first += chunk) {
+					size_t last = std::min(count, first + chunk);
+					ThreadPool::shared().submit(group, [&run, first, last]() {
+						run(first, last);
+					});
+				}
+				ThreadPool::shared().wait(group);
+				std::apply([](auto... cm) { (cm->end_parallel(), ...); }, _cmanagers);
 			}
 		private:
+			// the required component with the fewest entities, and how many it has.
+			size_t _pick_driver(size_t& count) const {
+				size_t sizes[] = { std::get<ComponentContainer<CFirst>*>(_cmanagers)->size(), std::get<ComponentContainer<COthers>*>(_cmanagers)->size()... };
+				size_t driver = 0;
+				for (size_t i = 1; i < 1 + sizeof...(COthers); ++i) {
+					if (!_is_optional[i] && sizes[i] < sizes[driver]) {
+						driver = i;
+					}
+				}
+				count = sizes[driver];
+				return driver;
+			}
+			// walks [first, last) of driver's container.
+			iterator _range(size_t driver, size_t first, size_t last) {
+				auto cm = std::get<ComponentContainer<CFirst>*>(_cmanagers);
+				if (driver != 0) {
+					return iterator(cm->end(), _cmanagers, _is_optional, _only_changed, driver, first, last);
+				}
+				return iterator(typename ComponentContainer<CFirst>::iterator(cm, first), typename ComponentContainer<CFirst>::iterator(cm, last), _cmanagers, _is_optional, _only_changed);
+			}
+
+			ComponentMask _required() const {
+				// CFirst can't be optional.
+				ComponentMask mask = (ComponentMask)1 << _cids[0];
+				for (size_t i = 1; i < 1 + sizeof...(COthers); ++i) {
+					if (!_is_optional[i]) {
+						mask |= (ComponentMask)1 << _cids[i];
+					}
+				}
+				return mask;
+			}
+
 			std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...> _cmanagers;
 			bool _is_optional[1 + sizeof...(COthers)];
+			bool _only_changed[1 + sizeof...(COthers)];
+			// nullptr unless archetypes are enabled.
+			const ArchetypeIndex* _archetypes;
+			bool _grouped;
+			size_t _cids[1 + sizeof...(COthers)];
 
 			template<typename CT, typename CH, typename... CR>
 			constexpr size_t _cindex() {
@@ -159,50 +411,290 @@ namespace MattECS {
 			}
 		};
 
+		class IView {
+		public:
+			virtual ~IView() = default;
+		};
+
+		// A registered query that remembers which entities matched and where their
+		// components sit, so walking it is a straight array walk. It only rescans
+		// when a container added or removed something, reorders just get patched.
+		template <typename CFirst, typename... COthers>
+		class View : public IView {
+		public:
+			class iterator {
+			public:
+				iterator(View* view, size_t row) : _view(view), _row(row) {}
+
+				iterator& operator++() {
+					_row++;
+					return *this;
+				}
+				bool operator==(iterator other) const { return _row == other._row; }
+				bool operator!=(iterator other) const { return _row != other._row; }
+
+				EntityID entity() const { return _view->_entities[_row]; }
+				// rows stay put until the next end_frame.
+				size_t row() const { return _row; }
+
+				template <typename C>
+				const C& value() {
+					auto index = _view->_rows[_row][_cindex<C, CFirst, COthers...>()];
+					return std::get<ComponentContainer<C>*>(_view->_cmanagers)->at(index);
+				}
+				template <typename C>
+				C& mut() {
+					auto index = _view->_rows[_row][_cindex<C, CFirst, COthers...>()];
+					std::get<ComponentContainer<C>*>(_view->_cmanagers)->set_changed(index);
+					return std::get<ComponentContainer<C>*>(_view->_cmanagers)->at(index);
+				}
+			private:
+				View* _view;
+				size_t _row;
+			};
+
+			View(std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...> managers) : _cmanagers(managers), _built(false) {
+				for (size_t i = 0; i < 1 + sizeof...(COthers); ++i) {
+					_versions[i] = 0;
+				}
+			}
+
+			iterator begin() {
+				_refresh();
+				return iterator(this, 0);
+			}
+			iterator end() {
+				_refresh();
+				return iterator(this, _entities.size());
+			}
+			iterator find(EntityID id) {
+				_refresh();
+				size_t slot = entity_slot(id);
+				if (slot >= _row_of.size() || _row_of[slot] == SIZE_MAX || _entities[_row_of[slot]] != id) {
+					return iterator(this, _entities.size());
+				}
+				return iterator(this, _row_of[slot]);
+			}
+			size_t size() {
+				_refresh();
+				return _entities.size();
+			}
+		private:
+			static constexpr size_t N = 1 + sizeof...(COthers);
+
+			void _refresh() {
+				size_t versions[N] = { std::get<ComponentContainer<CFirst>*>(_cmanagers)->layout_version(), std::get<ComponentContainer<COthers>*>(_cmanagers)->layout_version()... };
+				bool stale = !_built;
+				bool patchable = _built;
+				for (size_t i = 0; i < N; i++) {
+					if (versions[i] != _versions[i]) {
+						stale = true;
+						// only a single reorder since the last look can be patched.
+						IComponentContainer* cm = _container(i, std::index_sequence_for<CFirst, COthers...>{});
+						if (versions[i] != _versions[i] + 1 || cm->layout_rebuilt()) {
+							patchable = false;
+						}
+					}
+				}
+				if (!stale) {
+					return;
+				}
+				if (patchable) {
+					for (size_t i = 0; i < N; i++) {
+						if (versions[i] != _versions[i]) {
+							_patch(i, _container(i, std::index_sequence_for<CFirst, COthers...>{}));
+						}
+					}
+				}
+				else {
+					_rebuild(std::index_sequence_for<CFirst, COthers...>{});
+				}
+				for (size_t i = 0; i < N; i++) {
+					_versions[i] = versions[i];
+				}
+				_built = true;
+			}
+
+			template <std::size_t... Is>
+			IComponentContainer* _container(size_t i, std::index_sequence<Is...>) {
+				IComponentContainer* cm = nullptr;
+				((Is == i ? (cm = std::get<Is>(_cmanagers), true) : false) || ...);
+				return cm;
+			}
+
+			void _patch(size_t component, IComponentContainer* cm) {
+				SortedRange moved = cm->layout_moved();
+				for (size_t i = moved.first; i < moved.last; i++) {
+					EntityID id = cm->entity_at(i);
+					size_t slot = entity_slot(id);
+					if (slot < _row_of.size() && _row_of[slot] != SIZE_MAX && _entities[_row_of[slot]] == id) {
+						_rows[_row_of[slot]][component] = i;
+					}
+				}
+			}
+
+			template <std::size_t... Is>
+			void _rebuild(std::index_sequence<Is...>) {
+				for (auto id : _entities) {
+					_row_of[entity_slot(id)] = SIZE_MAX;
+				}
+				_entities.clear();
+				_rows.clear();
+
+				// scan the smallest container, same as Querier does.
+				size_t sizes[N] = { std::get<Is>(_cmanagers)->size()... };
+				size_t driver = 0;
+				for (size_t i = 1; i < N; i++) {
+					if (sizes[i] < sizes[driver]) {
+						driver = i;
+					}
+				}
+				for (size_t pos = 0; pos < sizes[driver]; pos++) {
+					EntityID id = 0;
+					((Is == driver ? (id = std::get<Is>(_cmanagers)->key_at(pos), true) : false) || ...);
+
+					std::optional<size_t> found[N] = { std::get<Is>(_cmanagers)->find(id).index()... };
+					if (!(found[Is] && ...)) {
+						continue;
+					}
+
+					size_t slot = entity_slot(id);
+					if (slot >= _row_of.size()) {
+						_row_of.resize(slot + 1, SIZE_MAX);
+					}
+					_row_of[slot] = _entities.size();
+					_entities.push_back(id);
+					_rows.push_back({ found[Is].value()... });
+				}
+			}
+
+			template<typename CT, typename CH, typename... CR>
+			static constexpr size_t _cindex() {
+				if constexpr (std::is_same<CT, CH>::value) {
+					return 0;
+				}
+				else {
+					return 1 + _cindex<CT, CR...>();
+				}
+			}
+
+			std::tuple<ComponentContainer<CFirst>*, ComponentContainer<COthers>*...> _cmanagers;
+			// layout_version() of each container the last time we looked.
+			size_t _versions[N];
+			bool _built;
+			std::vector<EntityID> _entities;
+			// the dense index of each component, a row per entity.
+			std::vector<std::array<size_t, N>> _rows;
+			// row of each entity slot, SIZE_MAX if it doesn't match.
+			std::vector<size_t> _row_of;
+		};
+
 		EntityManager() {
-			_last_id = 0;
-			_next_component_id = 0;
+			_archetypes_enabled = false;
+			_tick = 0;
+			_history_ticks = 0;
+			_history_first = 0;
+			_history_count = 0;
+			_open_slots.slot_count = 0;
 		}
 		~EntityManager() {
-			for (auto& it : _components) {
-				delete it.second;
+			for (auto view : _views) {
+				delete view;
+			}
+			for (auto cm : _containers) {
+				delete cm;
 			}
 		}
 
 		template <typename CFirst, typename... COthers>
 		Querier<CFirst, COthers...> query() {
-			return Querier(
+			const size_t cids[] = { component_type_id<CFirst>, component_type_id<COthers>... };
+			return Querier<CFirst, COthers...>(
+				std::make_tuple(
+					_manager<CFirst>(),
+					_manager<COthers>()...
+				),
+				_archetypes_enabled ? &_archetypes : nullptr,
+				cids
+			);
+		}
+
+		// Registers a cached query, see View. The EntityManager owns it, keep the
+		// pointer around instead of calling this every frame.
+		template <typename CFirst, typename... COthers>
+		View<CFirst, COthers...>* register_view() {
+			auto view = new View<CFirst, COthers...>(
 				std::make_tuple(
 					_manager<CFirst>(),
 					_manager<COthers>()...
 				)
 			);
+			_views.push_back(view);
+			return view;
+		}
+
+		// Start grouping entities into archetype tables so queries can use grouped().
+		// Costs some bookkeeping at every end_frame that adds or removes components.
+		void enable_archetypes() {
+			if (_archetypes_enabled) {
+				return;
+			}
+			assert(_component_list.size() <= MAX_COMPONENTS);
+			_archetypes_enabled = true;
+
+			std::unordered_map<EntityID, ComponentMask> masks;
+			for (size_t c = 0; c < _component_list.size(); c++) {
+				for (size_t i = 0; _component_list[c] && i < _component_list[c]->entity_count(); i++) {
+					masks[_component_list[c]->entity_at(i)] |= (ComponentMask)1 << c;
+				}
+			}
+			for (auto& it : masks) {
+				_archetypes.set(it.first, it.second, _component_list);
+			}
+			for (auto cm : _component_list) {
+				_archetype_versions.push_back(cm ? cm->layout_version() : 0);
+			}
 		}
 
 		template <
 			typename C,
-			typename void(*Orderer)(std::vector<size_t>&, SparseHashmap<EntityID, C>&) = no_orderer<C>,
+			SortedRange(*Orderer)(const std::vector<size_t>&, SparseHashmap<EntityID, C>&) = no_orderer<C>,
 			typename void(*OnChange)(EntityID, const C&) = no_change_handler<C>
 		>
 		size_t register_component() {
-			size_t id = _next_component_id++;
-			auto ti = std::type_index(typeid(C));
-			ComponentContainer<C, Orderer>* new_cm = new ComponentContainer<C, Orderer, OnChange>(MAX_ENTITIES);
-			_cpp_types[ti] = id;
-			_components[id] = new_cm;
-			// _idautomanagers[ti] = new_cm;
+			size_t id = component_type_id<C>;
+			assert((id >= _component_list.size() || _component_list[id] == nullptr) && "component registered twice");
+			_add_container(id, new ComponentContainer<C, Orderer, OnChange>(MAX_ENTITIES));
 			return id;
 		}
 		size_t register_script_component() {
-			size_t id = _next_component_id++;
-			ComponentContainer<char>* new_cm = new ComponentContainer<char>(MAX_ENTITIES);
-			_components[id] = new_cm;
+			// script components have no C++ type. They take ids after every type's
+			// and this manager's own, so each manager starts over instead of using
+			// up the shared ids.
+			size_t id = std::max(_component_list.size(), component_type_count());
+			_add_container(id, new ComponentContainer<char>(MAX_ENTITIES));
 			return id;
 		}
 
 		EntityID entity() {
-			EntityID new_id = _last_id++;
-			return new_id;
+			size_t slot;
+			if (!_free_slots.empty()) {
+				slot = _free_slots.back();
+				_free_slots.pop_back();
+			}
+			else {
+				slot = _generations.size();
+				assert(slot <= SPARSE_SLOT_MASK);
+				_generations.push_back(0);
+			}
+			_open_slots.reused.push_back(slot);
+			return make_entity_id(slot, _generations[slot]);
+		}
+
+		// false once remove_all was called for the id, even if its slot was reused.
+		bool alive(EntityID id) const {
+			size_t slot = entity_slot(id);
+			return slot < _generations.size() && (_generations[slot] & ENTITY_GENERATION_MASK) == entity_generation(id);
 		}
 
 		template <typename C>
@@ -234,12 +726,14 @@ namespace MattECS {
 		void add(EntityID id, Args&&... args) {
 			auto c = _manager<C>();
 			c->add_item<Args...>(id, std::forward<Args>(args)...);
+			_touch(id);
 		}
 
 		template <typename C>
 		void remove(EntityID id) {
 			auto c = _manager<C>();
 			c->delete_item(id);
+			_touch(id);
 		}
 		template <typename C, typename Second, typename... Others>
 		void remove(EntityID id) {
@@ -248,39 +742,252 @@ namespace MattECS {
 		}
 
 		void remove_all(EntityID id) {
-			for (auto& it : _components) {
-				it.second->delete_item(id);
+			if (!alive(id)) {
+				return;
+			}
+			for (auto cm : _containers) {
+				cm->delete_item(id);
 			}
+			_touch(id);
+			// the containers only drop the components at the end of the frame,
+			// the slot can't be handed out again until then.
+			_generations[entity_slot(id)]++;
+			_released_slots.push_back(entity_slot(id));
 		}
 
 		// finalize_update should be called when no iterators are held
 		// to avoid invalidating iterators. This will finalize added/removed
 		// components and entities.
 		void finalize_update() {
-			for (auto& it : _components) {
-				it.second->update_all();
+			for (auto cm : _containers) {
+				cm->update_all();
 			}
 		}
 
 		void end_frame() {
-			for (auto& it : _components) {
-				it.second->end_frame();
+			for (auto cm : _containers) {
+				cm->end_frame();
+			}
+			if (_archetypes_enabled) {
+				_update_archetypes();
 			}
+			_free_slots.insert(_free_slots.end(), _released_slots.begin(), _released_slots.end());
+			_open_slots.released = _released_slots;
+			_released_slots.clear();
+			if (_history_ticks > 0) {
+				_record_slots();
+			}
+			_open_slots.reused.clear();
+			_open_slots.slot_count = _generations.size();
+			_tick++;
+		}
+
+		// How many end_frames have run. The state at tick t is what there was right
+		// after the t-th end_frame.
+		size_t tick() const {
+			return _tick;
+		}
+
+		// Keep enough to go back up to ticks end_frames. Each container only keeps
+		// what changed in every tick, so this costs memory and end_frame time in
+		// proportion to the changes, not the number of entities. Registering another
+		// component afterwards starts the history over.
+		void enable_history(size_t ticks) {
+			_history_ticks = ticks;
+			_slot_history.clear();
+			_slot_history.resize(ticks);
+			_history_first = 0;
+			_history_count = 0;
+			for (auto cm : _containers) {
+				cm->set_history(ticks);
+			}
+		}
+		// the oldest tick tryGetAt and rewind can still reach.
+		size_t oldest_tick() const {
+			return _tick - _history_count;
+		}
+
+		// The component as it was at tick, between oldest_tick() and tick().
+		template <typename C>
+		const std::optional<const C*> tryGetAt(EntityID id, size_t tick) {
+			assert(tick >= oldest_tick() && tick <= _tick);
+			return _manager<C>()->find_past(id, _tick - tick);
+		}
+
+		// Goes back to how everything was at tick, dropping the ticks after it and
+		// anything done since the last end_frame. Ids handed out since then are
+		// dead again and will be handed out again. false if tick is out of reach.
+		bool rewind(size_t tick) {
+			if (tick < oldest_tick() || tick > _tick) {
+				return false;
+			}
+			size_t ticks = _tick - tick;
+
+			std::vector<EntityID> touched;
+			for (auto cm : _containers) {
+				cm->rewind(ticks, touched);
+			}
+
+			// the open frame first, its released slots aren't on the free list yet.
+			for (auto slot : _released_slots) {
+				_generations[slot]--;
+			}
+			_released_slots.clear();
+			_open_slots.released.clear();
+			_undo_slots(_open_slots);
+			// then the committed ones, newest first.
+			for (size_t i = 0; i < ticks; i++) {
+				_undo_slots(_slot_delta(i));
+			}
+			_history_count -= ticks;
+			_open_slots.reused.clear();
+			_open_slots.slot_count = _generations.size();
+			_tick = tick;
+
+			if (_archetypes_enabled) {
+				// out with every touched entity first, an entity coming back may
+				// share its slot with one that is going away.
+				for (auto id : touched) {
+					_archetypes.remove(id);
+				}
+				_touched.insert(_touched.end(), touched.begin(), touched.end());
+				_update_archetypes();
+				assert(_archetypes.matches(_component_list));
+			}
+			return true;
 		}
 	private:
+		// Entity slots one end_frame handed out and gave back.
+		struct SlotDelta {
+			// _generations.size() before the frame.
+			size_t slot_count;
+			// every slot entity() handed out, in order.
+			std::vector<size_t> reused;
+			std::vector<size_t> released;
+		};
+
+		// the ith newest committed SlotDelta.
+		SlotDelta& _slot_delta(size_t i) {
+			return _slot_history[(_history_first + _history_count - 1 - i) % _slot_history.size()];
+		}
+
+		void _record_slots() {
+			if (_history_count < _slot_history.size()) {
+				_history_count++;
+			}
+			else {
+				_history_first = (_history_first + 1) % _slot_history.size();
+			}
+			std::swap(_slot_delta(0), _open_slots);
+		}
+
+		void _undo_slots(const SlotDelta& delta) {
+			// released slots went on the end of the free list.
+			_free_slots.resize(_free_slots.size() - delta.released.size());
+			for (auto slot : delta.released) {
+				_generations[slot]--;
+			}
+			// and handed out slots came off it, or were new.
+			for (size_t i = delta.reused.size(); i > 0; i--) {
+				size_t slot = delta.reused[i - 1];
+				if (slot < delta.slot_count) {
+					_free_slots.push_back(slot);
+				}
+			}
+			_generations.resize(delta.slot_count);
+		}
+
+		void _add_container(size_t id, IComponentContainer* cm) {
+			if (id >= _component_list.size()) {
+				_component_list.resize(id + 1, nullptr);
+			}
+			_component_list[id] = cm;
+			_containers.push_back(cm);
+			if (_history_ticks > 0) {
+				enable_history(_history_ticks);
+			}
+		}
+
+		void _touch(EntityID id) {
+			if (_archetypes_enabled) {
+				_touched.push_back(id);
+			}
+		}
+
+		void _update_archetypes() {
+			// entities that gained or lost components move to their new table.
+			std::sort(_touched.begin(), _touched.end());
+			_touched.erase(std::unique(_touched.begin(), _touched.end()), _touched.end());
+			for (auto id : _touched) {
+				ComponentMask mask = 0;
+				for (size_t c = 0; c < _component_list.size(); c++) {
+					if (_component_list[c] && _component_list[c]->index_of(id)) {
+						mask |= (ComponentMask)1 << c;
+					}
+				}
+				_archetypes.set(id, mask, _component_list);
+			}
+			_touched.clear();
+
+			// then fix up the rows pointing at anything a container moved.
+			_archetype_versions.resize(_component_list.size(), 0);
+			for (size_t c = 0; c < _component_list.size(); c++) {
+				IComponentContainer* cm = _component_list[c];
+				if (!cm || cm->layout_version() == _archetype_versions[c]) {
+					continue;
+				}
+				// layout_moved() only covers the last end_frame. A rewind can run
+				// two, so more than one since the last look means any row moved.
+				bool rebuilt = cm->layout_rebuilt() || cm->layout_version() != _archetype_versions[c] + 1;
+				_archetype_versions[c] = cm->layout_version();
+				if (rebuilt) {
+					for (size_t i = 0; i < cm->entity_count(); i++) {
+						_archetypes.relocate(c, cm->entity_at(i), i);
+					}
+					continue;
+				}
+				SortedRange moved = cm->layout_moved();
+				for (size_t i = moved.first; i < moved.last; i++) {
+					_archetypes.relocate(c, cm->entity_at(i), i);
+				}
+			}
+		}
+
 		template <typename C>
 		ComponentContainer<C>* _manager() {
-			auto ti = std::type_index(typeid(C));
-			size_t id = _cpp_types[ti];
-			assert(_components.find(id) != _components.end());
-			return (ComponentContainer<C>*)_components[id];
+			size_t id = component_type_id<C>;
+			assert(id < _component_list.size() && _component_list[id] != nullptr && "component type was never registered");
+			return (ComponentContainer<C>*)_component_list[id];
 		}
 
-		// https://stackoverflow.com/questions/61281843/creating-compile-time-key-value-map-in-c
-		EntityID _last_id;
-		// std::unordered_map<std::type_index, IComponentContainer*> _idautomanagers;
-		size_t _next_component_id;
-		std::unordered_map<std::type_index, size_t> _cpp_types;
-		std::unordered_map<size_t, IComponentContainer*> _components;
+		// current generation of every slot ever handed out.
+		std::vector<size_t> _generations;
+		std::vector<size_t> _free_slots;
+		// removed this frame, free once the containers have caught up.
+		std::vector<size_t> _released_slots;
+		// every container this manager owns.
+		std::vector<IComponentContainer*> _containers;
+		// the same containers, indexed by component id. nullptr for ids of types
+		// that were only registered with some other EntityManager.
+		std::vector<IComponentContainer*> _component_list;
+
+		bool _archetypes_enabled;
+		ArchetypeIndex _archetypes;
+		// layout_version() of each container when the archetypes were last fixed up.
+		std::vector<size_t> _archetype_versions;
+		// entities that had components added or removed this frame.
+		std::vector<EntityID> _touched;
+
+		std::vector<IView*> _views;
+
+		size_t _tick;
+		// enable_history's ticks, 0 when it's off.
+		size_t _history_ticks;
+		// ring of the SlotDeltas of the last end_frames, like the containers keep.
+		std::vector<SlotDelta> _slot_history;
+		size_t _history_first;
+		size_t _history_count;
+		// the frame in progress.
+		SlotDelta _open_slots;
 	};
 };
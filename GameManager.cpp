@@ -1,5 +1,8 @@
 #include "GameManager.h"
 
+#include <algorithm>
+#include <iostream>
+
 #include "Action.h"
 #include "BaseScene.h"
 
@@ -10,14 +13,21 @@ GameManager::GameManager(std::shared_ptr<IFileManager> file_manager, std::unique
 	_asset_manager(std::move(assets)),
 	_map_manager(std::move(maps)),
 	_window(std::move(window)),
+	_quit(false),
 	_do_pop(false),
 	_to_push(),
-	_bg(sf::Color::Black) {}
+	_bg(sf::Color::Black),
+	_timings(nullptr),
+	_tick(0),
+	_replay_mismatches(0) {}
 
 GameManager::~GameManager() {}
 
 void GameManager::Quit() {
-	_window->close();
+	if (_window) {
+		_window->close();
+	}
+	_quit = true;
 }
 
 void GameManager::PushScene(std::unique_ptr<IScene> scene) {
@@ -34,7 +44,9 @@ void GameManager::ReplaceScene(std::unique_ptr<IScene> scene) {
 }
 
 void GameManager::SetCamera(const sf::View& camera) {
-	_window->setView(camera);
+	if (_window) {
+		_window->setView(camera);
+	}
 }
 
 void GameManager::SetActions(const std::unordered_map<sf::Keyboard::Key, ActionType>& action_map) {
@@ -49,31 +61,30 @@ void GameManager::SetBackgroundColor(const sf::Color c) {
 	_bg = c;
 }
 
+bool GameManager::Record(const std::string& path) {
+	return _recording.open(path);
+}
+
+bool GameManager::Replay(const std::string& path) {
+	return _replay.open(path);
+}
+
+bool GameManager::Script(const std::string& path) {
+	return _script.open(path);
+}
+
+void GameManager::SetSystemTimings(SystemTimings* timings) {
+	_timings = timings;
+}
+
 void GameManager::RunLoop() {
 	int time_remain = 0;
 	sf::Clock update_clock;
 	sf::Clock render_clock;
 
 	while (_window->isOpen()) {
-		if (_to_push) {
-			if (_scene_stack.size() > 0) {
-				IScene& scene = *_scene_stack.back();
-				scene.Hide(*this);
-			}
-
-			_scene_stack.push_back(std::move(_to_push.value()));
-			IScene& scene = *_scene_stack.back();
-			auto maybe_error = scene.Load(*this);
-			if (maybe_error) {
-				std::cerr << maybe_error.value().description << "\n";
-				return;
-			}
-			maybe_error = scene.Show(*this);
-			if (maybe_error) {
-				std::cerr << maybe_error.value().description << "\n";
-				return;
-			}
-			_to_push = {};
+		if (_to_push && !_push_scene()) {
+			return;
 		}
 
 		while (!_do_pop && !_to_push && _window->isOpen()) {
@@ -93,6 +104,9 @@ void GameManager::RunLoop() {
 				case sf::Event::KeyPressed:
 				case sf::Event::KeyReleased:
 				{
+					if (_replay.is_open()) {
+						break;
+					}
 					auto action_state = event.type == sf::Event::KeyPressed ? ActionState::START : ActionState::END;
 					auto action_it = _action_map.find(event.key.code);
 					if (action_it != _action_map.end()) {
@@ -105,21 +119,24 @@ void GameManager::RunLoop() {
 					break;
 				}
 			}
-			scene.OnAction(*this, actions, _current_action_states);
-
-			if (update_clock.getElapsedTime().asMilliseconds() >= MS_PER_TICK) {
+			int ticks = 0;
+			if (_replay.is_open()) {
+				if (!_next_replay_frame()) {
+					_window->close();
+					break;
+				}
+				actions = _frame.actions;
+				ticks = (int)_frame.tick_hashes.size();
+			}
+			else if (update_clock.getElapsedTime().asMilliseconds() >= MS_PER_TICK) {
 				sf::Time elapsed = update_clock.restart();
 				time_remain += elapsed.asMilliseconds();
-
-				while (time_remain >= MS_PER_TICK) {
-					sf::Clock clk;
-					scene.FixedUpdate(*this);
-					auto el = clk.getElapsedTime().asMicroseconds();
-					// std::cout << el << " us\n";
-					time_remain -= MS_PER_TICK;
-				}
+				ticks = time_remain / MS_PER_TICK;
+				time_remain -= ticks * MS_PER_TICK;
 			}
 
+			_run_ticks(scene, actions, ticks);
+
 			sf::Time elapsed = render_clock.restart();
 			_window->clear(_bg);
 			scene.Render(*this, *_window, elapsed.asMilliseconds());
@@ -129,31 +146,151 @@ void GameManager::RunLoop() {
 			scene.EndLoop(*this);
 		}
 
-		if (_do_pop) {
-			_do_pop = false;
-			if (_scene_stack.size() > 0) {
-				IScene& s = *_scene_stack.back();
-				auto maybe_error = s.Hide(*this);
-				if (maybe_error) {
-					std::cerr << maybe_error.value().description << "\n";
-					return;
+		if (_do_pop && !_pop_scene()) {
+			return;
+		}
+	}
+}
+
+uint64_t GameManager::RunHeadless(uint64_t ticks) {
+	uint64_t first_tick = _tick;
+	uint64_t last_tick = _tick + ticks;
+
+	while (!_quit && _tick < last_tick) {
+		if (_to_push && !_push_scene()) {
+			break;
+		}
+
+		while (!_do_pop && !_to_push && !_quit && _tick < last_tick) {
+			IScene& scene = *_scene_stack.back();
+
+			scene.BeginLoop(*this);
+
+			std::vector<Action> actions;
+			int loop_ticks = 1;
+			if (_replay.is_open()) {
+				if (!_next_replay_frame()) {
+					_quit = true;
+					break;
 				}
-				maybe_error = s.Unload(*this);
-				if (maybe_error) {
-					std::cerr << maybe_error.value().description << "\n";
-					return;
+				actions = _frame.actions;
+				loop_ticks = (int)std::min<uint64_t>(_frame.tick_hashes.size(), last_tick - _tick);
+			}
+			else if (_script.is_open()) {
+				_script.actions_at(_tick - first_tick, actions);
+				for (const auto& action : actions) {
+					_current_action_states[action.type] = action.state;
 				}
-				_scene_stack.pop_back();
+			}
+
+			_run_ticks(scene, actions, loop_ticks);
+
+			scene.EndLoop(*this);
+		}
 
-				SetCamera(_window->getDefaultView());
+		if (_do_pop) {
+			if (!_pop_scene()) {
+				break;
+			}
+			if (_scene_stack.empty() && !_to_push) {
+				_quit = true;
 			}
-			else {
-				_window->close();
+		}
+	}
+	return _tick - first_tick;
+}
+
+bool GameManager::IsHeadless() const {
+	return !_window;
+}
+
+bool GameManager::_push_scene() {
+	if (_scene_stack.size() > 0) {
+		IScene& scene = *_scene_stack.back();
+		scene.Hide(*this);
+	}
+
+	_scene_stack.push_back(std::move(_to_push.value()));
+	_to_push = {};
+	IScene& scene = *_scene_stack.back();
+	if (_timings) {
+		scene.SetSystemTimings(_timings);
+	}
+	auto maybe_error = scene.Load(*this);
+	if (maybe_error) {
+		std::cerr << maybe_error.value().description << "\n";
+		return false;
+	}
+	maybe_error = scene.Show(*this);
+	if (maybe_error) {
+		std::cerr << maybe_error.value().description << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool GameManager::_pop_scene() {
+	_do_pop = false;
+	if (_scene_stack.size() > 0) {
+		IScene& s = *_scene_stack.back();
+		auto maybe_error = s.Hide(*this);
+		if (maybe_error) {
+			std::cerr << maybe_error.value().description << "\n";
+			return false;
+		}
+		maybe_error = s.Unload(*this);
+		if (maybe_error) {
+			std::cerr << maybe_error.value().description << "\n";
+			return false;
+		}
+		_scene_stack.pop_back();
+
+		if (_window) {
+			SetCamera(_window->getDefaultView());
+		}
+	}
+	else {
+		Quit();
+	}
+	return true;
+}
+
+void GameManager::_run_ticks(IScene& scene, const std::vector<Action>& actions, int ticks) {
+	scene.OnAction(*this, actions, _current_action_states);
+
+	if (_recording.is_open()) {
+		_frame.actions = actions;
+		_frame.action_states = _current_action_states;
+		_frame.tick_hashes.clear();
+	}
+	for (int i = 0; i < ticks; i++) {
+		_profiler.next_tick();
+		scene.FixedUpdate(*this);
+		if (_recording.is_open()) {
+			_frame.tick_hashes.push_back(scene.StateHash());
+		}
+		else if (_replay.is_open() && scene.StateHash() != _frame.tick_hashes[i]) {
+			if (_replay_mismatches == 0) {
+				std::cout << "Replay diverged from the recording at tick " << _tick << "\n";
 			}
+			_replay_mismatches++;
 		}
+		_tick++;
+	}
+	if (_recording.is_open()) {
+		_recording.write(_frame);
 	}
 }
 
+bool GameManager::_next_replay_frame() {
+	if (!_replay.read(_frame)) {
+		std::cout << "Replay finished after " << _tick << " ticks, " << _replay_mismatches << " did not match the recording\n";
+		return false;
+	}
+	_current_action_states = _frame.action_states;
+	return true;
+}
+
 IFileManager& GameManager::file_manager() {
 	return *_file_manager;
 }
@@ -165,3 +302,7 @@ AssetManager& GameManager::asset_manager() {
 MapManager& GameManager::map_manager() {
 	return *_map_manager;
 }
+
+Profiler& GameManager::profiler() {
+	return _profiler;
+}
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -10,7 +11,10 @@
 #include "Action.h"
 #include "AssetManager.h"
 #include "IFileManager.h"
+#include "InputTrace.h"
 #include "MapManager.h"
+#include "Profiler.h"
+#include "SystemTimings.h"
 
 // Forward decl to avoid circular references.
 class IScene;
@@ -18,6 +22,7 @@ class IScene;
 class GameManager
 {
 public:
+	// Without a window the game can only be run headless.
 	GameManager(std::shared_ptr<IFileManager> file_manager, std::unique_ptr<AssetManager> assets, std::unique_ptr<MapManager> maps, std::unique_ptr<sf::RenderWindow> window);
 	~GameManager();
 
@@ -32,13 +37,41 @@ public:
 
 	void SetBackgroundColor(const sf::Color c);
 
+	// Writes every frame's input and the scene's hash after each tick to path.
+	bool Record(const std::string& path);
+	// Takes input from a recorded trace instead of the keyboard, running the same
+	// number of ticks per frame as the recording. Each tick's hash is checked
+	// against the recorded one and the first divergence is reported.
+	bool Replay(const std::string& path);
+	// Takes input from a hand written InputScript, headless runs only.
+	bool Script(const std::string& path);
+
+	// Scenes pushed from now on time their FixedUpdate systems into timings.
+	void SetSystemTimings(SystemTimings* timings);
+
 	void RunLoop();
+	// Runs up to ticks FixedUpdates as fast as possible, with no window, events
+	// or rendering. Every pass of the loop runs one tick on the scripted input,
+	// or as many as the recording did when replaying. Stops early on Quit(), once
+	// the last scene is popped or at the end of a replay. Returns the ticks run.
+	uint64_t RunHeadless(uint64_t ticks);
+	bool IsHeadless() const;
 
 	IFileManager& file_manager();
 	AssetManager& asset_manager();
 	MapManager& map_manager();
+	// Scenes time their systems into this while it is enabled.
+	Profiler& profiler();
 
 private:
+	// false if the scene failed to load or show.
+	bool _push_scene();
+	bool _pop_scene();
+	// OnAction, then the ticks, recording or checking each one's hash.
+	void _run_ticks(IScene& scene, const std::vector<Action>& actions, int ticks);
+	// next frame of the replay into _frame, false once it is used up.
+	bool _next_replay_frame();
+
 	std::shared_ptr<IFileManager> _file_manager;
 	std::unique_ptr<AssetManager> _asset_manager;
 	std::unique_ptr<MapManager> _map_manager;
@@ -51,6 +84,18 @@ private:
 	std::unordered_map<ActionType, ActionState> _current_action_states;
 
 	std::unique_ptr<sf::RenderWindow> _window;
+	// Quit() without a window.
+	bool _quit;
+
+	InputTraceWriter _recording;
+	InputTraceReader _replay;
+	InputScript _script;
+	SystemTimings* _timings;
+	Profiler _profiler;
+	TraceFrame _frame;
+	// fixed ticks run so far, across every scene.
+	uint64_t _tick;
+	uint64_t _replay_mismatches;
 
 	sf::Color _bg;
 };
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 
@@ -11,6 +12,7 @@
 
 #include "AssetManager.h"
 #include "EntityManager.h"
+#include "StateHasher.h"
 
 const int PLAYER_STARTING_HEALTH = 1;
 const int PLAYER_SMALL_PIERCE = 0;
@@ -21,6 +23,14 @@ const int ENTITY_HARDNESS = 0;
 
 const float DEG_TO_RAD = 3.14159f / 180.0f;
 
+// how far past the edge of a box the sensors reach.
+const float SENSOR_DISTANCE = 1.0f;
+// sprites are culled by their position, this covers how far a sprite can reach past it.
+const float SPRITE_CULL_MARGIN = 64.0f;
+// the profile overlay lists the slowest systems averaged over the last second.
+const size_t PROFILE_OVERLAY_SYSTEMS = 5;
+const uint64_t PROFILE_OVERLAY_TICKS = 50;
+
 std::string MARIO_SPRITESHEET = "MarioSmall";
 std::string MARIO_STAND_ANIMATION = "Stand";
 std::string MARIO_RUN_ANIMATION = "Run";
@@ -33,7 +43,6 @@ int MARIO_FALL_ANIMATION_ID;
 
 //
 // Ideas:
-// 2. Advanced tile map where we combine AABBs
 // 3. sort pos + aabb in the same order by X ascending
 //    also could sort sprites by Z maybe ?
 // 4. add a "nearby" style iteration to not iterate everything
@@ -113,10 +122,16 @@ GameScene::GameScene(const Map level) :
 	_player(0),
 	_coins(0),
 	_render_colliders(false),
+	_show_profile(false),
 	_milestone_reached(0),
 	_fpsclock(),
-	_frames(0)
+	_frames(0),
+	_collider_view(nullptr),
+	_broadphase((float)level.tile_width, (float)level.tile_height)
 {
+	_collider_render_box.setFillColor(sf::Color::Transparent);
+	_collider_render_box.setOutlineThickness(1.0f);
+
 	entity_manager().register_component<Sprite>();
 	entity_manager().register_component<Animation>();
 	entity_manager().register_component<Transform, MattECS::less_than_orderer<Transform, _transform_less>>();
@@ -127,29 +142,37 @@ GameScene::GameScene(const Map level) :
 	entity_manager().register_component<ZIndex, MattECS::less_than_orderer<ZIndex, _zindex_less>>();
 	entity_manager().register_component<Gravity>();
 	entity_manager().register_component<LimitedLifetime>();
+	entity_manager().register_component<ParticleSpawner>();
 	entity_manager().register_component<CTilemapRenderLayer>();
 	entity_manager().register_component<CTilemapParallaxLayer>();
 	entity_manager().register_component<OnCollisionHandler>();
+	// lets the wide collision queries walk archetype tables, see grouped().
+	entity_manager().enable_archetypes();
+	_collider_view = entity_manager().register_view<Transform, AABB>();
 
 	min_screen_x = _camera.getSize().x / 2.0f;
 	max_screen_x = (float)(_level.width * _level.tile_width) - min_screen_x;
 
-	RegisterActionSystem(&GameScene::InputSystem);
-	RegisterFixedUpdateSystem(&GameScene::AISystem);
-	RegisterFixedUpdateSystem(&GameScene::LifetimeSystem);
-	RegisterFixedUpdateSystem(&GameScene::GravitySystem);
-	RegisterFixedUpdateSystem(&GameScene::MovementSystem);
-	RegisterFixedUpdateSystem(&GameScene::DetectCollisionSystem);
+	RegisterActionSystem(&GameScene::InputSystem, "Input");
+	// anything adding or removing entities or running scripts stays exclusive.
+	RegisterFixedUpdateSystem(&GameScene::AISystem, SystemAccess(), "AI");
+	RegisterFixedUpdateSystem(&GameScene::LifetimeSystem, SystemAccess::exclusive(), "Lifetime");
+	RegisterFixedUpdateSystem(&GameScene::ParticleSystem, SystemAccess::exclusive(), "Particles");
+	// animation shares nothing with gravity, so the two run side by side. It
+	// has to come before movement, which writes Transform too.
+	RegisterFixedUpdateSystem(&GameScene::AnimationSystem, SystemAccess().reads<CTilemapParallaxLayer>().writes<Animation, Sprite, Transform, CTilemapRenderLayer>(), "Animation");
+	RegisterFixedUpdateSystem(&GameScene::GravitySystem, SystemAccess().reads<Gravity, Sensors>().writes<Movement>(), "Gravity");
+	RegisterFixedUpdateSystem(&GameScene::MovementSystem, SystemAccess().reads<Movement, Sensors>().writes<Transform, AABB>(), "Movement");
+	RegisterFixedUpdateSystem(&GameScene::DetectCollisionSystem, SystemAccess::exclusive(), "DetectCollision");
 	//RegisterFixedUpdateSystem(&GameScene::ResolveCollisionSystem);
-	RegisterFixedUpdateSystem(&GameScene::DestructionSystem);
-	RegisterFixedUpdateSystem(&GameScene::PlayerDeathSystem);
-	RegisterFixedUpdateSystem(&GameScene::PlayerVictorySystem);
-	RegisterFixedUpdateSystem(&GameScene::SetPlayerAnimationSystem);
-	RegisterFixedUpdateSystem(&GameScene::AnimationSystem);
+	RegisterFixedUpdateSystem(&GameScene::DestructionSystem, SystemAccess::exclusive(), "Destruction");
+	RegisterFixedUpdateSystem(&GameScene::PlayerDeathSystem, SystemAccess(), "PlayerDeath");
+	RegisterFixedUpdateSystem(&GameScene::PlayerVictorySystem, SystemAccess(), "PlayerVictory");
+	RegisterFixedUpdateSystem(&GameScene::SetPlayerAnimationSystem, SystemAccess().reads<Movement>().writes<Animation, Sprite, Transform>(), "SetPlayerAnimation");
 
-	RegisterRenderSystem(&GameScene::Render);
-	RegisterRenderGUISystem(&GameScene::DrawGUI);
-	RegisterRenderGUISystem(&GameScene::DrawBuffer);
+	RegisterRenderSystem(&GameScene::Render, "Render");
+	RegisterRenderGUISystem(&GameScene::DrawGUI, "DrawGUI");
+	RegisterRenderGUISystem(&GameScene::DrawBuffer, "DrawBuffer");
 
 	_script_compiler
 		.build_struct<MattECS::EntityID>("EntityID")
@@ -242,6 +265,8 @@ GameScene::GameScene(const Map level) :
 
 	_script_compiler.import_scoped_method<MattECS::EntityID,MattECS::EntityManager*>(
 		"EntityManager", "New", std::mem_fn(&MattECS::EntityManager::entity));
+	_script_compiler.import_scoped_method<bool,MattECS::EntityManager*,MattECS::EntityID>(
+		"EntityManager", "Alive", std::mem_fn(&MattECS::EntityManager::alive));
 	_script_compiler.import_scoped_method<void,MattECS::EntityManager*,MattECS::EntityID,float,float>(
 		"EntityManager", "Add_Transform", std::mem_fn(&MattECS::EntityManager::add<Transform,float,float>));
 	_script_compiler.import_scoped_method<void,MattECS::EntityManager*,MattECS::EntityID,float,float>(
@@ -281,7 +306,8 @@ std::shared_ptr<Program> GameScene::GetScript(std::string name) {
 }
 
 std::optional<SceneError> GameScene::Load(GameManager& gm) {
-	if (!_render_texture.create(256, 240)) {
+	// nothing is drawn without a window.
+	if (!gm.IsHeadless() && !_render_texture.create(256, 240)) {
 		return SceneError("Failed to create render destination");
 	}
 
@@ -313,6 +339,9 @@ std::optional<SceneError> GameScene::Load(GameManager& gm) {
 	_coins_text = sf::Text("Coins: 0", *font, 16);
 	_coins_text.setPosition(5.0f, 5.0f);
 
+	_profile_text = sf::Text("", *font, 8);
+	_profile_text.setPosition(5.0f, 25.0f);
+
 	const float item_size = 16.0f;
 	const float item_half = item_size / 2.0f;
 	_milestone_reached = 0;
@@ -351,25 +380,23 @@ std::optional<SceneError> GameScene::Load(GameManager& gm) {
 	float world_half_w = world_w / 2.0f;
 	float world_half_h = world_h / 2.0f;
 
+	_world_colliders.clear();
 	// left boundary
-	auto world_aabbs = entity_manager().entity();
-	entity_manager().add<Transform>(world_aabbs, -1.0f, world_half_h);
-	entity_manager().add<AABB>(world_aabbs, sf::Vector2f(2.0f, world_h), AABB::Material::Solid);
+	_world_colliders.push_back(StaticCollider{
+		sf::Vector2f(-1.0f, world_half_h), sf::Vector2f(1.0f, world_half_h),
+		AABB::Material::Solid, 0, 0, 0, false });
 	// right boundary
-	world_aabbs = entity_manager().entity();
-	entity_manager().add<Transform>(world_aabbs, world_w + 1.0f, world_half_h);
-	entity_manager().add<AABB>(world_aabbs, sf::Vector2f(2.0f, world_h), AABB::Material::Solid);
+	_world_colliders.push_back(StaticCollider{
+		sf::Vector2f(world_w + 1.0f, world_half_h), sf::Vector2f(1.0f, world_half_h),
+		AABB::Material::Solid, 0, 0, 0, false });
 	// no there is not a top boundary. this is explicit.
 
 	// add a deadly world AABB at the bottom
-	// or a bunch cause of the optimization to limit searching...
-	for (unsigned int i = 0; i < _level.width; i++) {
-		float x = (float)(i * _level.tile_width + (_level.tile_width / 2));
-		float w = (float)_level.tile_width;
-		world_aabbs = entity_manager().entity();
-		entity_manager().add<Transform>(world_aabbs, x, world_h + 1.0f);
-		entity_manager().add<AABB>(world_aabbs, sf::Vector2f(w, 2.0f), AABB::Material::Permeable, 999, 999, 999);
-	}
+	_world_colliders.push_back(StaticCollider{
+		sf::Vector2f(world_half_w, world_h + 1.0f), sf::Vector2f(world_half_w, 1.0f),
+		AABB::Material::Permeable, 999, 999, 999, false });
+
+	_tile_colliders.clear();
 
 	for (unsigned int i = 0; i < _level.layers.size(); i++) {
 		auto& layer = _level.layers[i];
@@ -389,28 +416,8 @@ std::optional<SceneError> GameScene::Load(GameManager& gm) {
 		float half_w = (float)_level.tile_width / 2.0f;
 		float half_h = (float)_level.tile_height / 2.0f;
 
-		// add AABBs
-		for (auto& tile : layer.tiles) {
-			if (tile.id <= 0) {
-				continue;
-			}
-			const auto& tile_info = layer.tileset.tiles[tile.id - 1];
-			if (tile_info.aabb.width > 0 && tile_info.aabb.height > 0) {
-				AABB::Material m;
-				if (tile_info.passage) {
-					m = AABB::Material::Permeable;
-				}
-				else {
-					m = AABB::Material::Solid;
-				}
-				auto e = entity_manager().entity();
-				entity_manager().add<Transform>(e, (float)(tile.x * _level.tile_width) + half_w, (float)(tile.y * _level.tile_height) + half_h);
-				entity_manager().add<AABB>(
-					e,
-					sf::Vector2f(tile_info.aabb.width, tile_info.aabb.height),
-					m, tile_info.damage, tile_info.hardness, tile_info.piercing);
-			}
-		}
+		// tiles never move, so their colliders are baked instead of being entities.
+		_tile_colliders.emplace_back(_level, i);
 
 		for (auto& entity : layer.entities) {
 			int sheetid = asset_manager.lookup_spritesheet_id(entity.spritesheet);
@@ -510,10 +517,40 @@ std::optional<SceneError> GameScene::Show(GameManager& gm) {
 	actions[sf::Keyboard::Key::P] = ActionType::PAUSE;
 	actions[sf::Keyboard::Key::G] = ActionType::GRID;
 	actions[sf::Keyboard::Key::Escape] = ActionType::MENU;
+	actions[sf::Keyboard::Key::F3] = ActionType::PROFILE;
 	gm.SetActions(actions);
 	return {};
 }
 
+uint64_t GameScene::StateHash() {
+	StateHasher h;
+	h.add((uint64_t)_player);
+	h.add(_coins);
+	h.add(_milestone_reached);
+
+	auto tq = entity_manager().query<Transform>();
+	for (auto it = tq.begin(); it != tq.end(); ++it) {
+		const Transform& t = it.value<Transform>();
+		h.add((uint64_t)it.entity());
+		h.add(t.position.x);
+		h.add(t.position.y);
+		h.add(t.scale.x);
+		h.add(t.scale.y);
+	}
+	auto mq = entity_manager().query<Movement>();
+	for (auto it = mq.begin(); it != mq.end(); ++it) {
+		h.add((uint64_t)it.entity());
+		h.add(it.value<Movement>().velocity.x);
+		h.add(it.value<Movement>().velocity.y);
+	}
+	auto hq = entity_manager().query<Mortal>();
+	for (auto it = hq.begin(); it != hq.end(); ++it) {
+		h.add((uint64_t)it.entity());
+		h.add(it.value<Mortal>().health);
+	}
+	return h.value();
+}
+
 // Get user input and translate to movement on the player
 // Components: Velocity*, BulletSpawner
 // May spawn with: Velocity, AABB, Lifetime, Animation
@@ -550,6 +587,15 @@ void GameScene::InputSystem(GameManager& gm, const std::vector<Action>& actions,
 				_render_colliders = !_render_colliders;
 			}
 			break;
+		case ActionType::PROFILE:
+			if (action.state == ActionState::END) {
+				_show_profile = !_show_profile;
+				// hiding the overlay stops recording, unless a --profile trace still needs it.
+				if (_show_profile || !gm.profiler().tracing()) {
+					gm.profiler().set_enabled(_show_profile);
+				}
+			}
+			break;
 		case ActionType::SHOOT:
 			break;
 		case ActionType::SELECT:
@@ -578,12 +624,49 @@ void GameScene::LifetimeSystem(GameManager& gm) {
 	}
 }
 
+// Throw out particles from the spawners that are due
+// Components: ParticleSpawner*
+// May spawn with: Velocity, Gravity, Lifetime, Animation
+void GameScene::ParticleSystem(GameManager& gm) {
+	// spawning while iterating would add to the container being walked.
+	_particles.clear();
+	auto query = entity_manager().query<ParticleSpawner, Transform>();
+	for (auto it = query.begin(); it != query.end(); ++it) {
+		ParticleSpawner& s = it.mut<ParticleSpawner>();
+		s.countdown -= 1;
+		if (s.countdown <= 0) {
+			s.countdown = s.rate;
+			s.spawned++;
+			_particles.emplace_back(it.value<Transform>().position, &s);
+		}
+	}
+
+	for (auto& [position, s] : _particles) {
+		// five lanes from left to right, the same every run.
+		float speed_x = (float)((int)(s->spawned % 5) - 2) * s->speed * 0.125f;
+
+		auto e = entity_manager().entity();
+		entity_manager().add<Transform>(e, position.x, position.y);
+		entity_manager().add<Gravity>(e);
+		entity_manager().add<LimitedLifetime>(e, s->lifetime);
+		entity_manager().add<Movement>(e, speed_x, -s->speed);
+		entity_manager().add<Sprite>(e, s->texture, s->config);
+		entity_manager().add<Animation>(e,
+			s->animation_id,
+			s->config,
+			true,
+			false
+		);
+		entity_manager().add<ZIndex>(e, s->z_index);
+	}
+}
+
 // Make objects fall if subject to gravity
 // Components: Velocity*, Gravity
 void GameScene::GravitySystem(GameManager& gm) {
 	auto query = entity_manager().query<Gravity, Movement, Sensors>().optional<Sensors>();
 
-	for (auto it = query.begin(); it != query.end(); ++it) {
+	query.par_each([this](decltype(query)::iterator& it) {
 		const auto& m = it.value<Movement>();
 		if (!it.has<Sensors>() || !it.value<Sensors>().bottom) {
 			if (m.velocity.y < _level.player.fall_speed) {
@@ -592,26 +675,25 @@ void GameScene::GravitySystem(GameManager& gm) {
 		} else if (m.velocity.y > 0.0f) {
 			it.mut<Movement>().velocity.y = 0.0f;
 		}
-	}
+	});
 }
 
 // Move objects with velocity
 // Components: Velocity, Position*
 void GameScene::MovementSystem(GameManager& gm) {
-	auto atq = entity_manager().query<AABB, Transform>();
-	for (auto it = atq.begin(); it != atq.end(); ++it) {
+	for (auto it = _collider_view->begin(); it != _collider_view->end(); ++it) {
 		AABB& aabb = it.mut<AABB>();
 		const Transform& t = it.value<Transform>();
 		aabb.previous_position = t.position;
 	}
 
 	auto mtsq = entity_manager().query<Movement, Transform, Sensors>().optional<Sensors>();
-	for (auto it = mtsq.begin(); it != mtsq.end(); ++it) {
+	mtsq.par_each([](decltype(mtsq)::iterator& it) {
 		const Movement& m = it.value<Movement>();
 		Transform& t = it.mut<Transform>();
 		t.position.x += m.velocity.x;
 		t.position.y += m.velocity.y;
-	}
+	});
 
 	const Transform& t = entity_manager().get<Transform>(_player);
 	for (unsigned int i = _milestone_reached; i < _level.milestones.size(); i++) {
@@ -655,250 +737,363 @@ std::tuple<bool, sf::Vector2f> overlap(
 	return std::make_tuple(true, sf::Vector2f(overlap_x, overlap_y));
 }
 
+// Finds how far along this tick's movement (0-1) each axis of two boxes first touched.
+// An axis that does not need to be resolved is left at 1.
+std::tuple<float, float> time_of_impact(
+	const sf::Vector2f& half_size1, const sf::Vector2f& previous1, const sf::Vector2f& vel1,
+	const sf::Vector2f& half_size2, const sf::Vector2f& previous2, const sf::Vector2f& vel2,
+	const sf::Vector2f& how_much) {
+
+	// we want to find when the two entities are JUST overlapping.
+	// how much tells us how far to move them apart.
+	// it's also how much overlap there is
+
+	// halfsizes = abs(spos1.x + vel1.x * t - (spos2.x + vel2.x * t))
+	// the rest assume's spos1.x > spos2.x, just negate halfsizes if otherwise.
+	// halfsizes + spos2.x + vel2.x * t = spos1.x + vel1.x * t
+	// halfsizes + spos2.x + vel2.x * t - spos1.x = vel1.x * t
+	// halfsizes + spos2.x - spos1.x = vel1.x * t - vel2.x * t
+	// (halfsizes + spos2.x - spos1.x) / (vel1.x - vel2.x) = t
+	// if vel1.x == vel2.x, there is no solution. they're moving in the same direction.
+
+	float desired_x = half_size1.x + half_size2.x;
+	float desired_y = half_size1.y + half_size2.y;
+
+	if (previous2.x > previous1.x) {
+		desired_x = -desired_x;
+	}
+	if (previous2.y > previous1.y) {
+		desired_y = -desired_y;
+	}
+
+	float tx = 1.0f;
+	float ty = 1.0f;
+	if (how_much.x != 0.0f && (vel1.x != 0.0 || vel2.x != 0.0) && vel1.x != vel2.x) {
+		float t = (desired_x + previous2.x - previous1.x) / (vel1.x - vel2.x);
+		if (t >= 0.0f && t < 1.0f) {
+			tx = t;
+		}
+	}
+	if (how_much.y != 0.0f && (vel1.y != 0.0 || vel2.y != 0.0) && vel1.y != vel2.y) {
+		float t = (desired_y + previous2.y - previous1.y) / (vel1.y - vel2.y);
+		if (t >= 0.0f && t < 1.0f) {
+			ty = t;
+		}
+	}
+	return std::make_tuple(tx, ty);
+}
+
 // Detects overlap of AABBs, but does not resolve. just stores results.
 // Components: AABB, Collision*
 void GameScene::DetectCollisionSystem(GameManager& gm) {
-	auto atq = entity_manager().query<Transform, AABB>();
-	auto atq_end = atq.end();
+	auto atq_end = _collider_view->end();
 
-	for (auto it = atq.begin(); it != atq_end; ++it) {
+	_broadphase.begin_sync();
+	_collider_columns.resize(_collider_view->size());
+	for (auto it = _collider_view->begin(); it != atq_end; ++it) {
 		AABB& aabb = it.mut<AABB>();
 		const Transform& t = it.value<Transform>();
 		aabb.collision = false;
 		aabb.previous_velocity.x = t.position.x - aabb.previous_position.x;
 		aabb.previous_velocity.y = t.position.y - aabb.previous_position.y;
+		_broadphase.update(it.entity(), t.position, aabb.half_size);
+		_collider_columns.set(it.row(), t.position, aabb);
 	}
+	_broadphase.end_sync();
 
-	// TODO: entities could be pushed inside of another moved entity... and boom
-	// Using a separate query for the optional pieces to only load when needed.
-	auto mmq = entity_manager().query<Mortal, Movement>().optional<Mortal>().optional<Movement>();
-	for (auto it = atq.begin(); it != atq_end; ++it) {
-		MattECS::EntityID e1 = it.entity();
-		const AABB& aabb1 = it.value<AABB>();
-		const Transform& t1 = it.value<Transform>();
+	for (StaticCollider* c : _static_contacts) {
+		c->collision = false;
+	}
+	_static_contacts.clear();
 
-		for (auto it2 = atq.find(e1); it2 != atq_end; ++it2) {
-			MattECS::EntityID e2 = it2.entity();
-			if (e1 == e2) {
-				continue;
-			}
-			const AABB& aabb2 = it2.value<AABB>();
-			const Transform& t2 = it2.value<Transform>();
+	// Only moving entities are tested against the baked tiles and world bounds.
+	// Tiles are not entities, so there are no script handlers to run for these.
+	auto mtaq = entity_manager().query<Movement, Transform, AABB, Mortal>().optional<Mortal>().grouped();
+	auto collide_static = [&](decltype(mtaq.begin())& it, StaticCollider& c) {
+		const AABB& aabb = it.value<AABB>();
+		const Transform& t = it.value<Transform>();
 
-			float too_far_away = aabb1.half_size.x + aabb2.half_size.x + 16.0f;
-			if (t2.position.x > t1.position.x + too_far_away) {
-				break;
-			}
+		bool has_overlap;
+		sf::Vector2f how_much;
+		std::tie(has_overlap, how_much) = overlap(aabb.half_size, t.position, c.half_size, c.position);
+		if (!has_overlap) {
+			return;
+		}
 
-			bool has_overlap;
-			sf::Vector2f how_much;
-			std::tie(has_overlap, how_much) = overlap(aabb1.half_size, t1.position, aabb2.half_size, t2.position);
+		it.mut<AABB>().collision = true;
+		if (!c.collision) {
+			c.collision = true;
+			_static_contacts.push_back(&c);
+		}
 
-			if (has_overlap) {
-				it.mut<AABB>().collision = true;
-				it2.mut<AABB>().collision = true;
+		if (c.damage > 0 && it.has<Mortal>() && c.piercing >= aabb.hardness) {
+			it.mut<Mortal>().health -= c.damage;
+		}
 
-				if (auto maybehandler = entity_manager().tryGet<OnCollisionHandler>(e1)) {
-					auto handler = maybehandler.value();
-					OnCollisionEvent evt = {&gm, &entity_manager(), this, e1, &aabb1, &t1, e2, &aabb2, &t2};
-					handler->handler(*_script_vm, *handler->state, &evt);
-				}
-				if (auto maybehandler = entity_manager().tryGet<OnCollisionHandler>(e2)) {
-					auto handler = maybehandler.value();
-					OnCollisionEvent evt = {&gm, &entity_manager(), this, e2, &aabb2, &t2, e1, &aabb1, &t1};
-					handler->handler(*_script_vm, *handler->state, &evt);
-				}
+		if (aabb.material == AABB::Material::Permeable || c.material == AABB::Material::Permeable) {
+			return;
+		}
 
-				auto mmit1 = mmq.find(e1);
-				bool is_dynamic1 = mmit1.has<Movement>();
-				bool is_deadly1 = aabb1.damage > 0.0f;
-				bool is_mortal1 = mmit1.has<Mortal>();
-
-				auto mmit2 = mmq.find(e2);
-				bool is_dynamic2 = mmit2.has<Movement>();
-				bool is_deadly2 = aabb2.damage > 0.0f;
-				bool is_mortal2 = mmit2.has<Mortal>();
-
-				// lava instantly kills any mortal that touches it
-				// fireballs remove 1 hp from any mortal that touches it AND the fireball dies
-				// lavaball removes 1 hp from any mortal that touches it, but does not die itself
-				// between two mortals neither are player:
-				//   nothing happens
-				// between mortal and player
-				//   top = the one with y velocity > 0 (falling) OR the not-player
-				//   bottom = the one that is not the top
-				//   the bottom loses 1 hp
-				//   if the bottom dies, then the top keeps falling
-				//   else the top bounces up
-				// after all then, then resolve collisions
-				// the unit AI will handle turning etc
-
-				// if both deadly and both mortal, resolve who "dies"
-				// if 1 deadly and other is mortal
-
-				if (is_deadly1 && is_mortal2 && aabb1.piercing >= aabb2.hardness) {
-					mmit2.mut<Mortal>().health -= aabb1.damage;
-				}
-				if (is_deadly2 && is_mortal1 && aabb2.piercing >= aabb1.hardness) {
-					mmit1.mut<Mortal>().health -= aabb2.damage;
-				}
+		sf::Vector2f vel(t.position.x - aabb.previous_position.x, t.position.y - aabb.previous_position.y);
+		if (vel.x == 0 && vel.y == 0) {
+			return;
+		}
 
-				// if either is permeable, then we don't adjust positions.
-				if (aabb1.material == AABB::Material::Permeable || aabb2.material == AABB::Material::Permeable) {
-					continue;
-				}
+		float tx;
+		float ty;
+		std::tie(tx, ty) = time_of_impact(
+			aabb.half_size, aabb.previous_position, vel,
+			c.half_size, c.position, sf::Vector2f(0.0f, 0.0f),
+			how_much);
+
+		if (tx < ty) {
+			if (tx >= 0.0 && tx < 1.0f && vel.x != 0.0f) {
+				it.mut<Transform>().position.x = aabb.previous_position.x + vel.x * tx;
+				it.mut<Movement>().velocity.x = 0.0f;
+			}
+		}
+		else {
+			if (ty >= 0.0 && ty < 1.0f && vel.y != 0.0f) {
+				it.mut<Transform>().position.y = aabb.previous_position.y + vel.y * ty;
+				it.mut<Movement>().velocity.y = 0.0f;
+			}
+		}
+	};
+	for (auto it = mtaq.begin(); it != mtaq.end(); ++it) {
+		const AABB& aabb = it.value<AABB>();
+		const Transform& t = it.value<Transform>();
 
-				if (is_dynamic1 || is_dynamic2) {
-					float vel_x_1 = is_dynamic1 ? (t1.position.x - aabb1.previous_position.x) : 0.0f;
-					float vel_y_1 = is_dynamic1 ? (t1.position.y - aabb1.previous_position.y) : 0.0f;
-					float vel_x_2 = is_dynamic2 ? (t2.position.x - aabb2.previous_position.x) : 0.0f;
-					float vel_y_2 = is_dynamic2 ? (t2.position.y - aabb2.previous_position.y) : 0.0f;
+		for (auto& grid : _tile_colliders) {
+			_static_candidates.clear();
+			grid.query(t.position, aabb.half_size, _static_candidates);
+			for (size_t i : _static_candidates) {
+				collide_static(it, grid.collider(i));
+			}
+		}
+		for (auto& c : _world_colliders) {
+			collide_static(it, c);
+		}
+		_broadphase.update(it.entity(), t.position, aabb.half_size);
+		_collider_columns.move(_collider_view->find(it.entity()).row(), t.position);
+	}
 
-					if (vel_x_1 == 0 && vel_y_1 == 0 && vel_x_2 == 0 && vel_y_2 == 0) {
-						continue;
-					}
+	// TODO: entities could be pushed inside of another moved entity... and boom
+	// Using a separate query for the optional pieces to only load when needed.
+	auto mmq = entity_manager().query<Mortal, Movement>().optional<Mortal>().optional<Movement>();
+	_collision_pairs.clear();
+	_broadphase.pairs(_collision_pairs);
+	// The pairs are sorted by the first id. Each run sharing it gets its candidates
+	// tested in one batch, and again only if resolving a pair moved the first box.
+	size_t run_start = 0;
+	size_t run_end = 0;
+	size_t row1 = 0;
+	sf::Vector2f tested;
+	for (size_t p = 0; p < _collision_pairs.size(); p++) {
+		MattECS::EntityID e1 = _collision_pairs[p].first;
+		MattECS::EntityID e2 = _collision_pairs[p].second;
+		if (p == run_end) {
+			run_start = p;
+			row1 = _collider_view->find(e1).row();
+			_pair_batch.clear();
+			for (run_end = p; run_end < _collision_pairs.size() && _collision_pairs[run_end].first == e1; run_end++) {
+				size_t candidate = _collider_view->find(_collision_pairs[run_end].second).row();
+				_pair_batch.add(_collider_columns.position(candidate), _collider_columns.half_size(candidate));
+			}
+			tested = _collider_columns.position(row1);
+			_pair_batch.test(tested, _collider_columns.half_size(row1));
+		}
+		else if (_collider_columns.position(row1) != tested) {
+			tested = _collider_columns.position(row1);
+			_pair_batch.test(tested, _collider_columns.half_size(row1));
+		}
+		if (!_pair_batch.hit(p - run_start)) {
+			continue;
+		}
 
-					// we want to find when the two entities are JUST overlapping.
-					// how much tells us how far to move them apart.
-					// it's also how much overlap there is
+		auto it = _collider_view->find(e1);
+		auto it2 = _collider_view->find(e2);
+		size_t row2 = it2.row();
+		const AABB& aabb1 = it.value<AABB>();
+		const Transform& t1 = it.value<Transform>();
+		const AABB& aabb2 = it2.value<AABB>();
+		const Transform& t2 = it2.value<Transform>();
+		sf::Vector2f how_much = _pair_batch.penetration(p - run_start);
 
-					// halfsizes = abs(spos1.x + vel1.x * t - (spos2.x + vel2.x * t))
-					// the rest assume's spos1.x > spos2.x, just negate halfsizes if otherwise.
-					// halfsizes + spos2.x + vel2.x * t = spos1.x + vel1.x * t
-					// halfsizes + spos2.x + vel2.x * t - spos1.x = vel1.x * t
-					// halfsizes + spos2.x - spos1.x = vel1.x * t - vel2.x * t
-					// (halfsizes + spos2.x - spos1.x) / (vel1.x - vel2.x) = t
-					// if vel1.x == vel2.x, there is no solution. they're moving in the same direction.
+		it.mut<AABB>().collision = true;
+		it2.mut<AABB>().collision = true;
 
-					float desired_x = aabb1.half_size.x + aabb2.half_size.x;
-					float desired_y = aabb1.half_size.y + aabb2.half_size.y;
+		if (auto maybehandler = entity_manager().tryGet<OnCollisionHandler>(e1)) {
+			auto handler = maybehandler.value();
+			OnCollisionEvent evt = {&gm, &entity_manager(), this, e1, &aabb1, &t1, e2, &aabb2, &t2};
+			handler->handler(*_script_vm, *handler->state, &evt);
+		}
+		if (auto maybehandler = entity_manager().tryGet<OnCollisionHandler>(e2)) {
+			auto handler = maybehandler.value();
+			OnCollisionEvent evt = {&gm, &entity_manager(), this, e2, &aabb2, &t2, e1, &aabb1, &t1};
+			handler->handler(*_script_vm, *handler->state, &evt);
+		}
 
-					if (aabb2.previous_position.x > aabb1.previous_position.x) {
-						desired_x = -desired_x;
-					}
-					if (aabb2.previous_position.y > aabb1.previous_position.y) {
-						desired_y = -desired_y;
-					}
+		auto mmit1 = mmq.find(e1);
+		bool is_dynamic1 = mmit1.has<Movement>();
+		bool is_deadly1 = aabb1.damage > 0.0f;
+		bool is_mortal1 = mmit1.has<Mortal>();
+
+		auto mmit2 = mmq.find(e2);
+		bool is_dynamic2 = mmit2.has<Movement>();
+		bool is_deadly2 = aabb2.damage > 0.0f;
+		bool is_mortal2 = mmit2.has<Mortal>();
+
+		// lava instantly kills any mortal that touches it
+		// fireballs remove 1 hp from any mortal that touches it AND the fireball dies
+		// lavaball removes 1 hp from any mortal that touches it, but does not die itself
+		// between two mortals neither are player:
+		//   nothing happens
+		// between mortal and player
+		//   top = the one with y velocity > 0 (falling) OR the not-player
+		//   bottom = the one that is not the top
+		//   the bottom loses 1 hp
+		//   if the bottom dies, then the top keeps falling
+		//   else the top bounces up
+		// after all then, then resolve collisions
+		// the unit AI will handle turning etc
+
+		// if both deadly and both mortal, resolve who "dies"
+		// if 1 deadly and other is mortal
+
+		if (is_deadly1 && is_mortal2 && aabb1.piercing >= aabb2.hardness) {
+			mmit2.mut<Mortal>().health -= aabb1.damage;
+		}
+		if (is_deadly2 && is_mortal1 && aabb2.piercing >= aabb1.hardness) {
+			mmit1.mut<Mortal>().health -= aabb2.damage;
+		}
+
+		// if either is permeable, then we don't adjust positions.
+		if (aabb1.material == AABB::Material::Permeable || aabb2.material == AABB::Material::Permeable) {
+			continue;
+		}
+
+		if (is_dynamic1 || is_dynamic2) {
+			float vel_x_1 = is_dynamic1 ? (t1.position.x - aabb1.previous_position.x) : 0.0f;
+			float vel_y_1 = is_dynamic1 ? (t1.position.y - aabb1.previous_position.y) : 0.0f;
+			float vel_x_2 = is_dynamic2 ? (t2.position.x - aabb2.previous_position.x) : 0.0f;
+			float vel_y_2 = is_dynamic2 ? (t2.position.y - aabb2.previous_position.y) : 0.0f;
+
+			if (vel_x_1 == 0 && vel_y_1 == 0 && vel_x_2 == 0 && vel_y_2 == 0) {
+				continue;
+			}
 
-					float tx = 1.0f;
-					float ty = 1.0f;
-					if (how_much.x != 0.0f && (vel_x_1 != 0.0 || vel_x_2 != 0.0) && vel_x_1 != vel_x_2) {
-						float t = (desired_x + aabb2.previous_position.x - aabb1.previous_position.x) / (vel_x_1 - vel_x_2);
-						if (t >= 0.0f && t < 1.0f) {
-							tx = t;
-						}
+			float tx;
+			float ty;
+			std::tie(tx, ty) = time_of_impact(
+				aabb1.half_size, aabb1.previous_position, sf::Vector2f(vel_x_1, vel_y_1),
+				aabb2.half_size, aabb2.previous_position, sf::Vector2f(vel_x_2, vel_y_2),
+				how_much);
+
+			// we use the smallest T to make sure both are satisifed.
+			// the smallest T will be the closest to the original position
+			// tx/ty will be 0 if it cannot be satisfied this frame, but we assume
+			// that the other will satisfy since the object JUST became overlapped.
+			if (tx < ty) {
+				if (tx >= 0.0 && tx < 1.0f) {
+					if (is_dynamic1 && vel_x_1 != 0.0f) {
+						Transform& tr = it.mut<Transform>();
+						tr.position.x = aabb1.previous_position.x + vel_x_1 * tx;
+						mmit1.mut<Movement>().velocity.x = 0.0f;
+						_broadphase.update(e1, tr.position, aabb1.half_size);
+						_collider_columns.move(row1, tr.position);
 					}
-					if (how_much.y != 0.0f && (vel_y_1 != 0.0 || vel_y_2 != 0.0) && vel_y_1 != vel_y_2) {
-						float t = (desired_y + aabb2.previous_position.y - aabb1.previous_position.y) / (vel_y_1 - vel_y_2);
-						if (t >= 0.0f && t < 1.0f) {
-							ty = t;
-						}
+					if (is_dynamic2 && vel_x_2 != 0.0f) {
+						Transform& tr = it2.mut<Transform>();
+						tr.position.x = aabb2.previous_position.x + vel_x_2 * tx;
+						mmit2.mut<Movement>().velocity.x = 0.0f;
+						_broadphase.update(e2, tr.position, aabb2.half_size);
+						_collider_columns.move(row2, tr.position);
 					}
-					// we use the smallest T to make sure both are satisifed.
-					// the smallest T will be the closest to the original position
-					// tx/ty will be 0 if it cannot be satisfied this frame, but we assume
-					// that the other will satisfy since the object JUST became overlapped.
-					if (tx < ty) {
-						if (tx >= 0.0 && tx < 1.0f) {
-							if (is_dynamic1 && vel_x_1 != 0.0f) {
-								Transform& tr = it.mut<Transform>();
-								tr.position.x = aabb1.previous_position.x + vel_x_1 * tx;
-								mmit1.mut<Movement>().velocity.x = 0.0f;
-							}
-							if (is_dynamic2 && vel_x_2 != 0.0f) {
-								Transform& tr = it2.mut<Transform>();
-								tr.position.x = aabb2.previous_position.x + vel_x_2 * tx;
-								mmit2.mut<Movement>().velocity.x = 0.0f;
-							}
-						}
+				}
+			}
+			else {
+				if (ty >= 0.0 && ty < 1.0f) {
+					if (is_dynamic1 && vel_y_1 != 0.0f) {
+						Transform& tr = it.mut<Transform>();
+						tr.position.y = aabb1.previous_position.y + vel_y_1 * ty;
+						mmit1.mut<Movement>().velocity.y = 0.0f;
+						_broadphase.update(e1, tr.position, aabb1.half_size);
+						_collider_columns.move(row1, tr.position);
 					}
-					else {
-						if (ty >= 0.0 && ty < 1.0f) {
-							if (is_dynamic1 && vel_y_1 != 0.0f) {
-								Transform& tr = it.mut<Transform>();
-								tr.position.y = aabb1.previous_position.y + vel_y_1 * ty;
-								mmit1.mut<Movement>().velocity.y = 0.0f;
-							}
-							if (is_dynamic2 && vel_y_2 != 0.0) {
-								Transform& tr = it2.mut<Transform>();
-								tr.position.y = aabb2.previous_position.y + vel_y_2 * ty;
-								mmit2.mut<Movement>().velocity.y = 0.0f;
-							}
-						}
+					if (is_dynamic2 && vel_y_2 != 0.0) {
+						Transform& tr = it2.mut<Transform>();
+						tr.position.y = aabb2.previous_position.y + vel_y_2 * ty;
+						mmit2.mut<Movement>().velocity.y = 0.0f;
+						_broadphase.update(e2, tr.position, aabb2.half_size);
+						_collider_columns.move(row2, tr.position);
 					}
-
-					auto t = fmin(tx, ty);
-					//if (t >= 0.0 && t < 1.0f) {
-					//	if (is_dynamic1 && (vel_x_1 != 0.0f || vel_y_1 != 0.0)) {
-					//		Transform& tr = it.mut<Transform>();
-					//		tr.position.x = aabb1.previous_position.x + vel_x_1 * t;
-					//		tr.position.y = aabb1.previous_position.y + vel_y_1 * t;
-					//	}
-					//	if (is_dynamic2 && (vel_x_2 != 0.0f || vel_y_2 != 0.0)) {
-					//		Transform& tr = it2.mut<Transform>();
-					//		tr.position.x = aabb2.previous_position.x + vel_x_2 * t;
-					//		tr.position.y = aabb2.previous_position.y + vel_y_2 * t;
-					//	}
-					//}
 				}
 			}
 
+			auto t = fmin(tx, ty);
+			//if (t >= 0.0 && t < 1.0f) {
+			//	if (is_dynamic1 && (vel_x_1 != 0.0f || vel_y_1 != 0.0)) {
+			//		Transform& tr = it.mut<Transform>();
+			//		tr.position.x = aabb1.previous_position.x + vel_x_1 * t;
+			//		tr.position.y = aabb1.previous_position.y + vel_y_1 * t;
+			//	}
+			//	if (is_dynamic2 && (vel_x_2 != 0.0f || vel_y_2 != 0.0)) {
+			//		Transform& tr = it2.mut<Transform>();
+			//		tr.position.x = aabb2.previous_position.x + vel_x_2 * t;
+			//		tr.position.y = aabb2.previous_position.y + vel_y_2 * t;
+			//	}
+			//}
 		}
 	}
 
-	auto staq = entity_manager().query<Sensors, Transform, AABB>();
+	auto staq = entity_manager().query<Sensors, Transform, AABB>().grouped();
 	for (auto it = staq.begin(); it != staq.end(); ++it) {
-		auto e1 = it.entity();
-		const AABB& aabb1 = it.value<AABB>();
-		const Transform& t1 = it.value<Transform>();
-		Sensors& s = it.mut<Sensors>();
-
-		const float sensor_dist = 1;
-
-		sf::Vector2f h_sensor_size = sf::Vector2f(sensor_dist, aabb1.half_size.y);
-		sf::Vector2f w_sensor_size = sf::Vector2f(aabb1.half_size.x, sensor_dist);
-
-		sf::Vector2f left_sensor = sf::Vector2f(t1.position.x - aabb1.half_size.x, t1.position.y);
-		sf::Vector2f right_sensor = sf::Vector2f(t1.position.x + aabb1.half_size.x, t1.position.y);
-		sf::Vector2f top_sensor = sf::Vector2f(t1.position.x, t1.position.y - aabb1.half_size.y);
-		sf::Vector2f bottom_sensor = sf::Vector2f(t1.position.x, t1.position.y + aabb1.half_size.y);
-
-		s.left = false;
-		s.right = false;
-		s.top = false;
-		s.bottom = false;
-
-		for (auto it2 = atq.begin(); it2 != atq.end(); ++it2) {
-			auto e2 = it2.entity();
-			const AABB& aabb2 = it2.value<AABB>();
-			const Transform& t2 = it2.value<Transform>();
+		const AABB& aabb = it.value<AABB>();
+		const Transform& t = it.value<Transform>();
+		it.mut<Sensors>() = ProbeSensors(it.entity(), t.position, aabb.half_size);
+	}
+}
 
-			if (e1 == e2) {
-				continue;
-			}
+Sensors GameScene::ProbeSensors(MattECS::EntityID entity, const sf::Vector2f& position, const sf::Vector2f& half_size) {
+	SensorProbe probe(position, half_size, SENSOR_DISTANCE);
+	_probe(entity, probe);
+	return probe.result;
+}
 
-			if (aabb2.material == AABB::Material::Permeable) {
-				continue;
+bool GameScene::_probe(MattECS::EntityID entity, SensorProbe& probe) {
+	// the static colliders are usually the ground, so test those first and skip
+	// gathering the dynamic ones when they already cover every edge.
+	_probe_batch.clear();
+	for (const auto& c : _world_colliders) {
+		if (c.material != AABB::Material::Permeable) {
+			_probe_batch.add(c.position, c.half_size);
+		}
+	}
+	for (const auto& grid : _tile_colliders) {
+		grid.visit(probe.position, probe.bounds_half_size, [&](size_t i) {
+			const StaticCollider& c = grid.collider(i);
+			if (c.material != AABB::Material::Permeable) {
+				_probe_batch.add(c.position, c.half_size);
 			}
+			return false;
+		});
+	}
+	if (probe.test(_probe_batch)) {
+		return true;
+	}
 
-			auto check = overlap(h_sensor_size, left_sensor, aabb2.half_size, t2.position);
-			if (std::get<0>(check)) {
-				s.left = true;
-			}
-			check = overlap(h_sensor_size, right_sensor, aabb2.half_size, t2.position);
-			if (std::get<0>(check)) {
-				s.right = true;
-			}
-			check = overlap(w_sensor_size, top_sensor, aabb2.half_size, t2.position);
-			if (std::get<0>(check)) {
-				s.top = true;
-			}
-			check = overlap(w_sensor_size, bottom_sensor, aabb2.half_size, t2.position);
-			if (std::get<0>(check)) {
-				s.bottom = true;
-			}
+	_probe_batch.clear();
+	_broadphase.visit(probe.position, probe.bounds_half_size, [&](MattECS::EntityID e2) {
+		if (e2 == entity) {
+			return false;
 		}
-	}
+		size_t row2 = _collider_view->find(e2).row();
+		if (_collider_columns.solid[row2]) {
+			_probe_batch.add(_collider_columns.position(row2), _collider_columns.half_size(row2));
+		}
+		return false;
+	});
+	return probe.test(_probe_batch);
 }
 
 // Resolve overlapping AABBs by shifting moving objects.
@@ -986,9 +1181,9 @@ void GameScene::SetPlayerAnimationSystem(GameManager& gm) {
 // Components: Animation*
 void GameScene::AnimationSystem(GameManager& gm) {
 	auto asq = entity_manager().query<Animation, Sprite>();
-	for (auto it = asq.begin(); it != asq.end(); ++it) {
+	asq.par_each([](decltype(asq)::iterator& it) {
 		if (it.value<Animation>().config->animation_frames <= 1) {
-			continue;
+			return;
 		}
 		Animation& ani = it.mut<Animation>();
 		Sprite& s = it.mut<Sprite>();
@@ -1001,14 +1196,26 @@ void GameScene::AnimationSystem(GameManager& gm) {
 
 		int x = (actual_frame * (ani.config->width + ani.config->animation_offset_x)) + ani.config->x;
 		s.set_rect(sf::FloatRect((float)x, (float)ani.config->y, (float)ani.config->width, (float)ani.config->height));
-	}
+	});
+
+	float camera_left = _camera.getCenter().x - _camera.getSize().x / 2;
+	sf::FloatRect view(camera_left, _camera.getCenter().y - _camera.getSize().y / 2, _camera.getSize().x, _camera.getSize().y);
 
-	auto cq = entity_manager().query<CTilemapRenderLayer>();
+	// only the chunks on or near the screen are animated, one chunk either side
+	// so chunks scrolling in are ready before they are seen. Layers without
+	// animated tiles never change, so they aren't mut()ed.
+	auto cq = entity_manager().query<CTilemapRenderLayer, Transform>();
 	for (auto it = cq.begin(); it != cq.end(); ++it) {
-		it.mut<CTilemapRenderLayer>().animate();
+		sf::Transform t = it.value<Transform>().transform();
+		if (it.value<CTilemapRenderLayer>().ani_multiple <= 1) {
+			it.value<CTilemapRenderLayer>().refresh(t, view, 1);
+			continue;
+		}
+		CTilemapRenderLayer& layer = it.mut<CTilemapRenderLayer>();
+		layer.animate();
+		layer.refresh(t, view, 1);
 	}
 
-	float camera_left = _camera.getCenter().x - _camera.getSize().x / 2;
 	float camera_top = 0.0f;
 
 	auto ptq = entity_manager().query<CTilemapParallaxLayer, Transform>();
@@ -1029,40 +1236,62 @@ void GameScene::Render(GameManager& gm, sf::RenderWindow& window, int delta_ms)
 	//gm.SetCamera(_camera);
 	_render_texture.setView(_camera);
 
-	auto sq = entity_manager().query<Sprite>();
-	auto tq = entity_manager().query<CTilemapRenderLayer>();
-
-	auto ztq = entity_manager().query<ZIndex, Transform>();
-	for (auto it = ztq.begin(); it != ztq.end(); ++it) {
-		auto entity = it.entity();
-
-		auto sqit = sq.find(entity);
-		if (sqit != sq.end()) {
-			sqit.value<Sprite>().render(_render_texture, it.value<Transform>().transform());
-			continue;
+	sf::Vector2f view_size = _camera.getSize();
+	sf::FloatRect view(_camera.getCenter() - view_size / 2.0f, view_size);
+
+	_sprite_batch.clear();
+	_sprite_batch.set_view(view);
+
+	// Transforms are kept sorted by x, so jump straight to the left edge of the
+	// screen and stop once we are past the right edge.
+	float cull_left = view.left - SPRITE_CULL_MARGIN;
+	float cull_right = view.left + view.width + SPRITE_CULL_MARGIN;
+	auto tsq = entity_manager().query<Transform, Sprite, ZIndex>();
+	auto first = tsq.partition_point([cull_left](const Transform& t) {
+		return t.position.x < cull_left;
+	});
+	for (auto it = first; it != tsq.end(); ++it) {
+		const Transform& t = it.value<Transform>();
+		if (t.position.x > cull_right) {
+			break;
 		}
+		_sprite_batch.add(it.value<ZIndex>().z_index, it.value<Sprite>(), t.transform());
+	}
 
-		auto tqit = tq.find(entity);
-		if (tqit != tq.end()) {
-			tqit.value<CTilemapRenderLayer>().render(_render_texture, it.value<Transform>().transform());
-			continue;
-		}
+	// the layers cull their own chunks, parallax included. Chunks are usually
+	// built by the animation step already, but a camera jump can outrun it.
+	auto ltq = entity_manager().query<CTilemapRenderLayer, Transform, ZIndex>();
+	for (auto it = ltq.begin(); it != ltq.end(); ++it) {
+		sf::Transform t = it.value<Transform>().transform();
+		const CTilemapRenderLayer& layer = it.value<CTilemapRenderLayer>();
+		layer.refresh(t, view, 0);
+		_sprite_batch.add(it.value<ZIndex>().z_index, layer, t);
 	}
+	_sprite_batch.draw(_render_texture);
 
 	if (_render_colliders) {
-		auto atq = entity_manager().query<AABB, Transform>();
-		for (auto it = atq.begin(); it != atq.end(); ++it) {
-			AABB& aabb = it.mut<AABB>();
-			const Transform& t = it.value<Transform>();
-			if (aabb.collision) {
-				aabb.render_box.setOutlineColor(sf::Color::Red);
-			}
-			else {
-				aabb.render_box.setOutlineColor(sf::Color::White);
-			}
-			aabb.render_box.setPosition(t.position.x, t.position.y);
+		auto draw_box = [&](const sf::Vector2f& position, const sf::Vector2f& half_size, bool collision) {
+			_collider_render_box.setSize(sf::Vector2f(half_size.x * 2.0f, half_size.y * 2.0f));
+			_collider_render_box.setOrigin(half_size.x, half_size.y);
+			_collider_render_box.setOutlineColor(collision ? sf::Color::Red : sf::Color::White);
+			_collider_render_box.setPosition(position.x, position.y);
+			_render_texture.draw(_collider_render_box);
+		};
+		for (auto it = _collider_view->begin(); it != _collider_view->end(); ++it) {
+			const AABB& aabb = it.value<AABB>();
+			draw_box(it.value<Transform>().position, aabb.half_size, aabb.collision);
+		}
 
-			_render_texture.draw(aabb.render_box);
+		auto draw_static = [&](const StaticCollider& c) {
+			draw_box(c.position, c.half_size, c.collision);
+		};
+		for (const auto& grid : _tile_colliders) {
+			for (size_t i = 0; i < grid.size(); i++) {
+				draw_static(grid.collider(i));
+			}
+		}
+		for (const auto& c : _world_colliders) {
+			draw_static(c);
 		}
 	}
 }
@@ -1081,6 +1310,15 @@ void GameScene::DrawGUI(GameManager& gm, sf::RenderWindow& window, int delta_ms)
 		std::stringstream fpsbuilder;
 		fpsbuilder << fps << " fps";
 		_fps_text.setString(fpsbuilder.str());
+
+		if (_show_profile) {
+			std::stringstream profilebuilder;
+			profilebuilder << std::fixed << std::setprecision(2);
+			for (const auto& it : gm.profiler().top(PROFILE_OVERLAY_SYSTEMS, PROFILE_OVERLAY_TICKS)) {
+				profilebuilder << gm.profiler().name(it.first) << " " << it.second / 1000.0 << " ms\n";
+			}
+			_profile_text.setString(profilebuilder.str());
+		}
 	}
 
 	_render_texture.draw(_fps_text);
@@ -1089,6 +1327,10 @@ void GameScene::DrawGUI(GameManager& gm, sf::RenderWindow& window, int delta_ms)
 	coinbuilder << "Coins: " << _coins;
 	_coins_text.setString(coinbuilder.str());
 	_render_texture.draw(_coins_text);
+
+	if (_show_profile) {
+		_render_texture.draw(_profile_text);
+	}
 }
 
 void GameScene::DrawBuffer(GameManager& gm, sf::RenderWindow& window, int delta_ms) {
@@ -11,8 +11,14 @@
 
 #include "Action.h"
 #include "BaseScene.h"
+#include "ColliderColumns.h"
 #include "Components.h"
 #include "MapManager.h"
+#include "OverlapBatch.h"
+#include "SensorProbe.h"
+#include "SpatialHash.h"
+#include "SpriteBatch.h"
+#include "TileCollisionGrid.h"
 
 class GameScene : public BaseScene<GameScene> {
 public:
@@ -24,6 +30,9 @@ public:
 	virtual std::optional<SceneError> Unload(GameManager& gm);
 	virtual std::optional<SceneError> Show(GameManager& gm);
 
+	// Every entity's transform, velocity and health plus the level progress.
+	virtual uint64_t StateHash();
+
 private:
 	// Get user input and translate to movement on the player
 	// Components: Velocity*, BulletSpawner
@@ -39,6 +48,10 @@ private:
 	// Update objects with limited lifetime and destroy afterwards
 	// Components: Lifetime*
 	void LifetimeSystem(GameManager& gm);
+	// Throw out particles from the spawners that are due
+	// Components: ParticleSpawner*
+	// May spawn with: Velocity, Gravity, Lifetime, Animation
+	void ParticleSystem(GameManager& gm);
 	// Make objects fall if subject to gravity
 	// Components: Velocity*, Gravity
 	void GravitySystem(GameManager& gm);
@@ -50,6 +63,11 @@ private:
 	// Components: AABB, Collision*
 	void DetectCollisionSystem(GameManager& gm);
 
+	// Sensor queries against the tiles, world bounds and broadphase.
+	// Probes stop as soon as every edge has hit something solid.
+	Sensors ProbeSensors(MattECS::EntityID entity, const sf::Vector2f& position, const sf::Vector2f& half_size);
+	bool _probe(MattECS::EntityID entity, SensorProbe& probe);
+
 	// Resolve overlapping AABBs by shifting moving objects.
 	// Components: Collision, Velocity*, Position*
 	void ResolveCollisionSystem(GameManager& gm);
@@ -108,16 +126,35 @@ private:
 	float max_screen_x;
 
 	bool _render_colliders;
+	// F3 shows the systems that took the longest, per tick.
+	bool _show_profile;
+	sf::Text _profile_text;
 	int _milestone_reached;
 
 	int _frames;
 	sf::Text _fps_text;
 	sf::Clock _fpsclock;
 
-	// there exists one vert array for each spritesheet (texture ptr)
-	// now this impl does assume that items on different layers (Z)
-	// have separate textures.
-	// std::vector<sf::VertexArray> _vert_arrays;
-	// where in the above array a ptr exists.
-	// std::unordered_map<void*, unsigned int> _va_location;
+	// every Transform + AABB, walked several times a tick so the matches are cached.
+	MattECS::EntityManager::View<Transform, AABB>* _collider_view;
+	// Broadphase for every Transform + AABB, synced at the start of DetectCollisionSystem.
+	SpatialHash _broadphase;
+	// the same boxes by _collider_view row, synced alongside the broadphase.
+	ColliderColumns _collider_columns;
+	// Tile colliders baked per layer plus the world bounds. These never move.
+	std::vector<TileCollisionGrid> _tile_colliders;
+	std::vector<StaticCollider> _world_colliders;
+	// static colliders hit this tick, so only those need their flag cleared.
+	std::vector<StaticCollider*> _static_contacts;
+	// debug outline, shared by every collider.
+	sf::RectangleShape _collider_render_box;
+	// scratch space kept around to avoid allocating every tick.
+	std::vector<SpatialHash::Pair> _collision_pairs;
+	std::vector<size_t> _static_candidates;
+	std::vector<std::pair<sf::Vector2f, const ParticleSpawner*>> _particles;
+	OverlapBatch _pair_batch;
+	OverlapBatch _probe_batch;
+
+	// sprites are batched into one vert array per z + spritesheet each frame.
+	SpriteBatch _sprite_batch;
 };
@@ -0,0 +1,254 @@
+#include "InputTrace.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+	const char TRACE_MAGIC[4] = { 'M', 'T', 'R', 'C' };
+	const uint8_t TRACE_VERSION = 1;
+	// in place of the state count when the states didn't change.
+	const uint8_t STATES_UNCHANGED = 0xff;
+
+	const std::pair<const char*, ActionType> SCRIPT_ACTIONS[] = {
+		{ "UP", ActionType::UP },
+		{ "DOWN", ActionType::DOWN },
+		{ "LEFT", ActionType::LEFT },
+		{ "RIGHT", ActionType::RIGHT },
+		{ "JUMP", ActionType::JUMP },
+		{ "SHOOT", ActionType::SHOOT },
+		{ "GRID", ActionType::GRID },
+		{ "MENU", ActionType::MENU },
+		{ "SELECT", ActionType::SELECT },
+		{ "PAUSE", ActionType::PAUSE },
+		{ "PROFILE", ActionType::PROFILE },
+	};
+}
+
+InputTraceWriter::InputTraceWriter() {}
+
+bool InputTraceWriter::open(const std::string& path) {
+	_out.open(path, std::ios::binary | std::ios::trunc);
+	if (!_out) {
+		return false;
+	}
+	_out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	_u8(TRACE_VERSION);
+	_last_states.clear();
+	return (bool)_out;
+}
+
+bool InputTraceWriter::is_open() const {
+	return _out.is_open();
+}
+
+void InputTraceWriter::write(const TraceFrame& frame) {
+	_u16((uint16_t)frame.actions.size());
+	for (const auto& a : frame.actions) {
+		_u8((uint8_t)a.type);
+		_u8((uint8_t)a.state);
+	}
+
+	// sorted so the same states always compare and write the same way.
+	std::vector<std::pair<ActionType, ActionState>> states(frame.action_states.begin(), frame.action_states.end());
+	std::sort(states.begin(), states.end());
+	if (states == _last_states) {
+		_u8(STATES_UNCHANGED);
+	}
+	else {
+		_u8((uint8_t)states.size());
+		for (const auto& s : states) {
+			_u8((uint8_t)s.first);
+			_u8((uint8_t)s.second);
+		}
+		_last_states = states;
+	}
+
+	_u16((uint16_t)frame.tick_hashes.size());
+	for (auto h : frame.tick_hashes) {
+		_u64(h);
+	}
+}
+
+void InputTraceWriter::_u8(uint8_t v) {
+	_out.put((char)v);
+}
+
+void InputTraceWriter::_u16(uint16_t v) {
+	_u8((uint8_t)(v & 0xff));
+	_u8((uint8_t)(v >> 8));
+}
+
+void InputTraceWriter::_u64(uint64_t v) {
+	for (int i = 0; i < 8; i++) {
+		_u8((uint8_t)(v >> (i * 8)));
+	}
+}
+
+InputTraceReader::InputTraceReader() {}
+
+bool InputTraceReader::open(const std::string& path) {
+	_in.open(path, std::ios::binary);
+	if (!_in) {
+		return false;
+	}
+	char magic[sizeof(TRACE_MAGIC)];
+	_in.read(magic, sizeof(magic));
+	uint8_t version;
+	if (!_in || !std::equal(magic, magic + sizeof(magic), TRACE_MAGIC) || !_u8(version) || version != TRACE_VERSION) {
+		_in.close();
+		return false;
+	}
+	_last_states.clear();
+	return true;
+}
+
+bool InputTraceReader::is_open() const {
+	return _in.is_open();
+}
+
+bool InputTraceReader::read(TraceFrame& frame) {
+	frame.actions.clear();
+	frame.tick_hashes.clear();
+
+	uint16_t action_count;
+	if (!_u16(action_count)) {
+		return false;
+	}
+	for (uint16_t i = 0; i < action_count; i++) {
+		uint8_t type;
+		uint8_t state;
+		if (!_u8(type) || !_u8(state)) {
+			return false;
+		}
+		frame.actions.push_back(Action{ (ActionType)type, (ActionState)state });
+	}
+
+	uint8_t state_count;
+	if (!_u8(state_count)) {
+		return false;
+	}
+	if (state_count != STATES_UNCHANGED) {
+		_last_states.clear();
+		for (uint8_t i = 0; i < state_count; i++) {
+			uint8_t type;
+			uint8_t state;
+			if (!_u8(type) || !_u8(state)) {
+				return false;
+			}
+			_last_states[(ActionType)type] = (ActionState)state;
+		}
+	}
+	frame.action_states = _last_states;
+
+	uint16_t tick_count;
+	if (!_u16(tick_count)) {
+		return false;
+	}
+	for (uint16_t i = 0; i < tick_count; i++) {
+		uint64_t h;
+		if (!_u64(h)) {
+			return false;
+		}
+		frame.tick_hashes.push_back(h);
+	}
+	return true;
+}
+
+bool InputTraceReader::_u8(uint8_t& v) {
+	char c;
+	if (!_in.get(c)) {
+		return false;
+	}
+	v = (uint8_t)c;
+	return true;
+}
+
+bool InputTraceReader::_u16(uint16_t& v) {
+	uint8_t lo;
+	uint8_t hi;
+	if (!_u8(lo) || !_u8(hi)) {
+		return false;
+	}
+	v = (uint16_t)(lo | (hi << 8));
+	return true;
+}
+
+bool InputTraceReader::_u64(uint64_t& v) {
+	v = 0;
+	for (int i = 0; i < 8; i++) {
+		uint8_t b;
+		if (!_u8(b)) {
+			return false;
+		}
+		v |= (uint64_t)b << (i * 8);
+	}
+	return true;
+}
+
+InputScript::InputScript() : _open(false), _next(0) {}
+
+bool InputScript::open(const std::string& path) {
+	_open = false;
+	_entries.clear();
+	_next = 0;
+
+	std::ifstream in(path);
+	if (!in) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		std::string action;
+		std::string state;
+		Entry entry;
+		if (!(words >> entry.tick)) {
+			// blank or comment only.
+			if (line.find_first_not_of(" \t\r") == std::string::npos) {
+				continue;
+			}
+			return false;
+		}
+		if (!(words >> action >> state)) {
+			return false;
+		}
+
+		auto found = std::find_if(std::begin(SCRIPT_ACTIONS), std::end(SCRIPT_ACTIONS), [&action](const auto& a) {
+			return action == a.first;
+		});
+		if (found == std::end(SCRIPT_ACTIONS)) {
+			return false;
+		}
+		entry.action.type = found->second;
+		if (state == "start") {
+			entry.action.state = ActionState::START;
+		}
+		else if (state == "end") {
+			entry.action.state = ActionState::END;
+		}
+		else {
+			return false;
+		}
+		_entries.push_back(entry);
+	}
+
+	std::stable_sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) {
+		return a.tick < b.tick;
+	});
+	_open = true;
+	return true;
+}
+
+bool InputScript::is_open() const {
+	return _open;
+}
+
+void InputScript::actions_at(uint64_t tick, std::vector<Action>& actions) {
+	while (_next < _entries.size() && _entries[_next].tick <= tick) {
+		if (_entries[_next].tick == tick) {
+			actions.push_back(_entries[_next].action);
+		}
+		_next++;
+	}
+}
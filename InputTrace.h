@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Action.h"
+
+// One pass of the game loop: the input it saw, and the state hash after each
+// FixedUpdate it ran. Replaying the frames in order reruns the same ticks.
+struct TraceFrame {
+	std::vector<Action> actions;
+	std::unordered_map<ActionType, ActionState> action_states;
+	std::vector<uint64_t> tick_hashes;
+};
+
+// Trace files are a small header followed by the frames. Everything is little
+// endian and one byte per action, action states are only written when they
+// differ from the frame before.
+class InputTraceWriter {
+public:
+	InputTraceWriter();
+
+	bool open(const std::string& path);
+	bool is_open() const;
+	void write(const TraceFrame& frame);
+
+private:
+	void _u8(uint8_t v);
+	void _u16(uint16_t v);
+	void _u64(uint64_t v);
+
+	std::ofstream _out;
+	std::vector<std::pair<ActionType, ActionState>> _last_states;
+};
+
+class InputTraceReader {
+public:
+	InputTraceReader();
+
+	bool open(const std::string& path);
+	bool is_open() const;
+	// false once the trace is used up, or if it ends in the middle of a frame.
+	bool read(TraceFrame& frame);
+
+private:
+	bool _u8(uint8_t& v);
+	bool _u16(uint16_t& v);
+	bool _u64(uint64_t& v);
+
+	std::ifstream _in;
+	std::unordered_map<ActionType, ActionState> _last_states;
+};
+
+// Input written by hand, for benchmarks and other runs without a keyboard. One
+// "<tick> <action> <start|end>" per line, like "30 JUMP start", and # starts a
+// comment. Ticks count from the first FixedUpdate of the run.
+class InputScript {
+public:
+	InputScript();
+
+	// false if the file is missing or a line doesn't parse.
+	bool open(const std::string& path);
+	bool is_open() const;
+	// Appends the actions for tick in file order. Ticks have to be asked for in
+	// increasing order.
+	void actions_at(uint64_t tick, std::vector<Action>& actions);
+
+private:
+	struct Entry {
+		uint64_t tick;
+		Action action;
+	};
+
+	bool _open;
+	std::vector<Entry> _entries;
+	size_t _next;
+};
@@ -0,0 +1,202 @@
+#include "LevelGenerator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <random>
+
+namespace {
+	const char* TILESET = "maps/tileset-outdoor.txt";
+	const char* SPRITESHEET = "OutdoorTilesheet";
+
+	// tileset ids, 0 is no tile.
+	const unsigned int GROUND_TILE = 1;
+	// Brick, Solid Block, Question Block, Square Brick, Coin
+	const unsigned int PLATFORM_TILES[] = { 2, 14, 36, 38, 47 };
+	// clouds, bushes, leaves and hills, none of them solid.
+	const unsigned int DECORATION_TILES[] = { 9, 10, 11, 22, 23, 24, 58, 59, 60, 61, 70, 79 };
+
+	// only ground this far from the left, the player starts there.
+	const unsigned int START_COLUMNS = 6;
+	const unsigned int SKY_ROWS = 2;
+	const unsigned int GROUND_ROWS = 2;
+	// chance of a gap in the ground starting at any column.
+	const float GAP_CHANCE = 1.0f / 16.0f;
+
+	// mt19937 gives the same numbers everywhere, the std distributions don't.
+	unsigned int pick(std::mt19937& rng, size_t n) {
+		return (unsigned int)(rng() % n);
+	}
+
+	bool chance(std::mt19937& rng, float p) {
+		return (double)rng() < (double)p * 4294967296.0;
+	}
+
+	void write_tiles(std::ostream& out, const std::vector<unsigned int>& tiles, unsigned int width, unsigned int height) {
+		out << "tiles = [\n";
+		for (unsigned int y = 0; y < height; y++) {
+			out << "\t[";
+			for (unsigned int x = 0; x < width; x++) {
+				out << (x > 0 ? ", " : " ") << std::setw(2) << tiles[y * width + x];
+			}
+			out << "],\n";
+		}
+		out << "]\n";
+	}
+}
+
+void generate_level(const LevelGeneratorConfig& config, std::ostream& out) {
+	std::mt19937 rng(config.seed);
+
+	unsigned int width = std::max(config.width, START_COLUMNS + 2);
+	unsigned int height = std::max(config.height, SKY_ROWS + GROUND_ROWS + 2);
+	unsigned int layers = std::max(config.layers, 1u);
+	unsigned int entity_layer = layers;
+	unsigned int ground = height - GROUND_ROWS;
+
+	out << "# generated: width " << width
+		<< ", height " << height
+		<< ", layers " << layers
+		<< ", density " << config.density
+		<< ", scripted " << config.scripted_entities
+		<< ", spawners " << config.spawners
+		<< ", seed " << config.seed << "\n";
+	out << "gravity = 0.1\n"
+		<< "width = " << width << "\n"
+		<< "height = " << height << "\n"
+		<< "tile_width = 16\n"
+		<< "tile_height = 16\n\n";
+
+	out << "[player]\n"
+		<< "aabb = { width = 12, height = 16 }\n"
+		<< "run_speed = 1.5\n"
+		<< "jump_speed = 3.2\n"
+		<< "fall_speed = 3\n"
+		<< "layer = " << entity_layer << "\n\n";
+
+	out << "[[milestones]]\nx = 2\ny = " << ground - 1 << "\n\n";
+	out << "[[milestones]]\nx = " << width / 2 << "\ny = " << ground - 1 << "\n\n";
+
+	// background layers, further back the lower they are.
+	for (unsigned int l = 0; l + 1 < layers; l++) {
+		std::vector<unsigned int> tiles(width * height, 0);
+		for (unsigned int y = SKY_ROWS; y < ground; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				if (chance(rng, config.density)) {
+					tiles[y * width + x] = DECORATION_TILES[pick(rng, std::size(DECORATION_TILES))];
+				}
+			}
+		}
+		out << "[[layers]]\n"
+			<< "tileset = \"" << TILESET << "\"\n"
+			<< "parallax = " << (float)(l + 1) / (float)layers << "\n";
+		write_tiles(out, tiles, width, height);
+		out << "\n";
+	}
+
+	// the solid layer: ground with gaps, then platforms over it.
+	std::vector<unsigned int> solid(width * height, 0);
+	unsigned int gap = 0;
+	for (unsigned int x = 0; x < width; x++) {
+		if (gap > 0) {
+			gap--;
+			continue;
+		}
+		for (unsigned int y = ground; y < height; y++) {
+			solid[y * width + x] = GROUND_TILE;
+		}
+		if (x >= START_COLUMNS && chance(rng, GAP_CHANCE)) {
+			gap = 2 + pick(rng, 2);
+		}
+	}
+	// the row just above the ground stays open to walk along.
+	for (unsigned int y = SKY_ROWS; y + 1 < ground; y++) {
+		for (unsigned int x = START_COLUMNS; x < width; x++) {
+			if (chance(rng, config.density)) {
+				solid[y * width + x] = PLATFORM_TILES[pick(rng, std::size(PLATFORM_TILES))];
+			}
+		}
+	}
+	out << "[[layers]]\n"
+		<< "tileset = \"" << TILESET << "\"\n";
+	write_tiles(out, solid, width, height);
+	out << "\n";
+
+	// entities and spawners take open cells, picked without repeats.
+	std::vector<unsigned int> open;
+	for (unsigned int y = SKY_ROWS; y < ground; y++) {
+		for (unsigned int x = START_COLUMNS; x < width; x++) {
+			if (solid[y * width + x] == 0) {
+				open.push_back(y * width + x);
+			}
+		}
+	}
+	size_t wanted = std::min<size_t>((size_t)config.scripted_entities + config.spawners, open.size());
+	for (size_t i = 0; i < wanted; i++) {
+		std::swap(open[i], open[i + pick(rng, open.size() - i)]);
+	}
+	size_t scripted = std::min<size_t>(config.scripted_entities, wanted);
+
+	out << "[[layers]]\n# entity layer, no tiles.\n";
+	for (size_t i = 0; i < scripted; i++) {
+		bool coins = i % 2 == 1;
+		out << "\n[[layers.entities]]\n"
+			<< "spritesheet = \"" << SPRITESHEET << "\"\n"
+			<< "sprite = \"" << (coins ? "QuestionBlock" : "Brick") << "\"\n"
+			<< "aabb = { width = 14, height = 16 }\n"
+			<< "x = " << open[i] % width << "\n"
+			<< "y = " << open[i] / width << "\n\n"
+			<< "[[layers.entities.scripts]]\n";
+		if (coins) {
+			out << "path = \"scripts/coinblock.wut\"\n"
+				<< "vars = { coins = 3, coin_layer = " << entity_layer << " }\n";
+		}
+		else {
+			out << "path = \"scripts/shatterblock.wut\"\n";
+		}
+		out << "events = [\"collide\"]\n";
+	}
+	for (size_t i = scripted; i < wanted; i++) {
+		out << "\n[[layers.spawners]]\n"
+			<< "spritesheet = \"" << SPRITESHEET << "\"\n"
+			<< "sprite = \"Coin\"\n"
+			<< "x = " << open[i] % width << "\n"
+			<< "y = " << open[i] / width << "\n"
+			<< "rate = " << 4 + pick(rng, 4) << "\n"
+			<< "lifetime = 60\n"
+			<< "speed = 3\n";
+	}
+}
+
+std::vector<LevelSweepPoint> level_sweep() {
+	LevelGeneratorConfig base;
+	base.width = 640;
+
+	std::vector<LevelSweepPoint> points;
+	for (unsigned int width = 40; width <= 5120; width *= 2) {
+		LevelGeneratorConfig level = base;
+		level.width = width;
+		points.push_back(LevelSweepPoint{ "width", level });
+	}
+	for (float density : { 0.0f, 0.05f, 0.1f, 0.2f, 0.4f, 0.8f }) {
+		LevelGeneratorConfig level = base;
+		level.density = density;
+		points.push_back(LevelSweepPoint{ "density", level });
+	}
+	for (unsigned int layers : { 1u, 2u, 4u, 8u, 16u }) {
+		LevelGeneratorConfig level = base;
+		level.layers = layers;
+		points.push_back(LevelSweepPoint{ "layers", level });
+	}
+	for (unsigned int scripted : { 0u, 64u, 256u, 1024u, 4096u }) {
+		LevelGeneratorConfig level = base;
+		level.scripted_entities = scripted;
+		points.push_back(LevelSweepPoint{ "scripted", level });
+	}
+	for (unsigned int spawners : { 0u, 16u, 64u, 256u, 1024u }) {
+		LevelGeneratorConfig level = base;
+		level.spawners = spawners;
+		points.push_back(LevelSweepPoint{ "spawners", level });
+	}
+	return points;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// How big and busy a generated level is.
+struct LevelGeneratorConfig {
+	// in tiles
+	unsigned int width = 160;
+	unsigned int height = 15;
+	// tile layers, the last one is solid and the rest are parallax background.
+	// The entities get a layer of their own on top.
+	unsigned int layers = 3;
+	// chance [0, 1] of each open cell above the ground getting a tile.
+	float density = 0.1f;
+	// bricks and question blocks running scripts/shatterblock.wut or scripts/coinblock.wut.
+	unsigned int scripted_entities = 16;
+	unsigned int spawners = 4;
+	// the same seed and config always make the same level.
+	uint32_t seed = 0;
+};
+
+// One level of a benchmark sweep. Each series changes one thing from the
+// same base level, so its points make one curve.
+struct LevelSweepPoint {
+	std::string series;
+	LevelGeneratorConfig level;
+};
+
+// Writes a level in the maps/level1-1.txt format out of the tiles in
+// maps/tileset-outdoor.txt. The player starts on solid ground at the left,
+// scripted entities and spawners go in cells with no tile.
+void generate_level(const LevelGeneratorConfig& config, std::ostream& out);
+
+// Width, density, layers, scripted entities and spawners, each swept from
+// well under to well over what the real levels have.
+std::vector<LevelSweepPoint> level_sweep();
@@ -1,5 +1,7 @@
 #include "MapManager.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "toml.hpp"
@@ -11,6 +13,159 @@ move_parallax_layer(Transform& t, const CTilemapParallaxLayer& pl, float camera_
 	t.position.x = camera_x - (camera_x * pl.parallax);
 }
 
+CTilemapRenderLayer::CTilemapRenderLayer() :
+	layer(std::make_shared<TilemapLayerChunks>()), tile_width(0.0f), tile_height(0.0f), texture(nullptr), animation_tick(0), ani_multiple(1) {}
+
+CTilemapRenderLayer::CTilemapRenderLayer(const Map& map, unsigned int l, sf::Texture& t) :
+	layer(std::make_shared<TilemapLayerChunks>()), tile_width((float)map.tile_width), tile_height((float)map.tile_height), texture(&t), animation_tick(0), ani_multiple(1)
+{
+	const LayerConfig& config = map.layers[l];
+	std::vector<TilemapChunk>& chunks = layer->chunks;
+	std::vector<TilemapTileFrame>& frames = layer->frames;
+
+	std::unordered_map<unsigned int, bool> ani_frames;
+	frames.reserve(config.tileset.tiles.size());
+	for (const auto& tconf : config.tileset.tiles) {
+		frames.push_back(TilemapTileFrame{
+			(float)tconf.x, (float)tconf.y,
+			(float)tconf.width, (float)tconf.height,
+			tconf.animation_frames, tconf.animation_rate
+		});
+		if (tconf.animation_frames > 1 && tconf.animation_rate > 0) {
+			ani_frames[tconf.animation_frames * tconf.animation_rate] = true;
+		}
+	}
+
+	// find the multiplier for the animation ticks
+	for (auto& it : ani_frames) {
+		ani_multiple = ani_multiple * it.first;
+	}
+
+	for (const auto& tile : config.tiles) {
+		if (tile.id <= 0) {
+			continue;
+		}
+		unsigned int c = tile.x / TILEMAP_CHUNK_COLUMNS;
+		if (c >= chunks.size()) {
+			chunks.resize(c + 1);
+		}
+		TilemapChunk& chunk = chunks[c];
+		const TilemapTileFrame& frame = frames[tile.id - 1];
+		if (frame.animation_frames > 1 && frame.animation_rate > 0) {
+			chunk.animated.push_back((unsigned int)chunk.tiles.size());
+		}
+		chunk.tiles.push_back(TilemapChunkTile{ tile.x, tile.y, tile.id - 1 });
+	}
+}
+
+void CTilemapRenderLayer::animate() {
+	animation_tick++;
+	if (animation_tick >= ani_multiple) {
+		animation_tick -= ani_multiple;
+	}
+}
+
+void CTilemapRenderLayer::refresh(const sf::Transform& transform, const sf::FloatRect& view, int margin) const {
+	auto range = _chunk_range(transform, view, margin);
+	for (int c = range.first; c <= range.second; c++) {
+		TilemapChunk& chunk = layer->chunks[c];
+		if (!chunk.built) {
+			_build(chunk);
+		}
+		else if (chunk.tick != animation_tick) {
+			_animate(chunk);
+		}
+	}
+}
+
+void CTilemapRenderLayer::render(sf::RenderTarget& target, const sf::Transform& transform, const sf::FloatRect& view) const {
+	sf::RenderStates states;
+	states.texture = texture;
+	states.transform = transform;
+
+	auto range = _chunk_range(transform, view, 0);
+	for (int c = range.first; c <= range.second; c++) {
+		const TilemapChunk& chunk = layer->chunks[c];
+		if (chunk.built && chunk.verts.getVertexCount() > 0) {
+			target.draw(chunk.verts, states);
+		}
+	}
+}
+
+size_t CTilemapRenderLayer::built_chunks() const {
+	size_t built = 0;
+	for (const auto& chunk : layer->chunks) {
+		if (chunk.built) {
+			built++;
+		}
+	}
+	return built;
+}
+
+std::pair<int, int> CTilemapRenderLayer::_chunk_range(const sf::Transform& transform, const sf::FloatRect& view, int margin) const {
+	if (layer->chunks.empty()) {
+		return std::make_pair(0, -1);
+	}
+	float chunk_width = tile_width * (float)TILEMAP_CHUNK_COLUMNS;
+	sf::FloatRect local = transform.getInverse().transformRect(view);
+	int first = std::max(0, (int)std::floor(local.left / chunk_width) - margin);
+	int last = std::min((int)layer->chunks.size() - 1, (int)std::floor((local.left + local.width) / chunk_width) + margin);
+	return std::make_pair(first, last);
+}
+
+void CTilemapRenderLayer::_build(TilemapChunk& chunk) const {
+	chunk.verts.resize(4 * chunk.tiles.size());
+	for (size_t i = 0; i < chunk.tiles.size(); i++) {
+		const TilemapChunkTile& tile = chunk.tiles[i];
+
+		float x = (float)tile.x * tile_width;
+		float y = (float)tile.y * tile_height;
+		float r = x + tile_width;
+		float b = y + tile_height;
+
+		sf::Vertex* quad = &chunk.verts[i * 4];
+
+		quad[0].position = sf::Vector2f(x, y);
+		quad[1].position = sf::Vector2f(r, y);
+		quad[2].position = sf::Vector2f(r, b);
+		quad[3].position = sf::Vector2f(x, b);
+
+		const TilemapTileFrame& frame = layer->frames[tile.frame];
+		float tx = frame.tx;
+		float ty = frame.ty;
+		float tr = tx + frame.width;
+		float tb = ty + frame.height;
+
+		quad[0].texCoords = sf::Vector2f(tx, ty);
+		quad[1].texCoords = sf::Vector2f(tr, ty);
+		quad[2].texCoords = sf::Vector2f(tr, tb);
+		quad[3].texCoords = sf::Vector2f(tx, tb);
+	}
+	chunk.built = true;
+	_animate(chunk);
+}
+
+void CTilemapRenderLayer::_animate(TilemapChunk& chunk) const {
+	for (auto i : chunk.animated) {
+		const TilemapChunkTile& tile = chunk.tiles[i];
+		const TilemapTileFrame& frame = layer->frames[tile.frame];
+		auto current = (float)((animation_tick / frame.animation_rate) % frame.animation_frames);
+
+		sf::Vertex* quad = &chunk.verts[i * 4];
+
+		float tx = frame.tx + (current * frame.width);
+		float ty = frame.ty;
+		float tr = tx + frame.width;
+		float tb = ty + frame.height;
+
+		quad[0].texCoords = sf::Vector2f(tx, ty);
+		quad[1].texCoords = sf::Vector2f(tr, ty);
+		quad[2].texCoords = sf::Vector2f(tr, tb);
+		quad[3].texCoords = sf::Vector2f(tx, tb);
+	}
+	chunk.tick = animation_tick;
+}
+
 //bool
 //generate_components(const Tilemap& tmap, MattECS::EntityManager& em, AssetManager& am) {
 //	for (unsigned int i = 0; i < tmap.layers.size(); i++) {
@@ -31,7 +186,7 @@ move_parallax_layer(Transform& t, const CTilemapParallaxLayer& pl, float camera_
 //		float half_h = (float)tmap.tile_height / 2.0f;
 //
 //		// add AABBs
-//		for (const auto& tile : layer.tiles) {
+//		for (const auto& tile : config.tiles) {
 //			if (tile.id <= 0) {
 //				continue;
 //			}
@@ -181,6 +336,32 @@ MapManager::parse_entities(toml::node_view<toml::node> n) {
 	return entities;
 }
 
+SpawnerConfig
+MapManager::parse_spawner(toml::node_view<toml::node> n) {
+	return SpawnerConfig{
+		n["spritesheet"].value_or<std::string>(""),
+		n["sprite"].value_or<std::string>(""),
+		n["x"].value_or<unsigned int>(0),
+		n["y"].value_or<unsigned int>(0),
+		std::max(n["rate"].value_or<unsigned int>(1), 1u),
+		std::max(n["lifetime"].value_or<unsigned int>(1), 1u),
+		n["speed"].value_or<float>(0.0f)
+	};
+}
+
+std::vector<SpawnerConfig>
+MapManager::parse_spawners(toml::node_view<toml::node> n) {
+	std::vector<SpawnerConfig> spawners;
+
+	if (auto arr = n.as_array()) {
+		for (auto& e : *arr) {
+			auto node = toml::node_view<toml::node>(e);
+			spawners.push_back(parse_spawner(node));
+		}
+	}
+	return spawners;
+}
+
 TileSetTileConfig
 MapManager::parse_tileset_tile(toml::node_view<toml::node> tile_config) {
 	std::string name = tile_config["name"].value_or<std::string>("");
@@ -294,6 +475,7 @@ MapManager::parse_layer(toml::node_view<toml::node> n, unsigned int width, unsig
 	}
 	
 	auto entities = parse_entities(n["entities"]);
+	auto spawners = parse_spawners(n["spawners"]);
 
 	return LayerConfig{
 		parallax,
@@ -301,7 +483,8 @@ MapManager::parse_layer(toml::node_view<toml::node> n, unsigned int width, unsig
 		layer_height,
 		tsc,
 		tiles,
-		entities
+		entities,
+		spawners
 	};
 }
 
@@ -391,9 +574,23 @@ MapManager::get_level(std::string name) {
 	if (it == _levels.end()) {
 		return {};
 	}
+	return parse_level(_file_manager->load_file(it->second), name);
+}
 
+std::optional<Map>
+MapManager::load_level(std::string path) {
+	std::string source = _file_manager->load_file(path);
+	if (source.empty()) {
+		std::cerr << "Failed to read level " << path << "\n";
+		return {};
+	}
+	return parse_level(source, path);
+}
+
+std::optional<Map>
+MapManager::parse_level(const std::string& source, const std::string& name) {
 	try {
-		toml::table toml_config = toml::parse(_file_manager->load_file(it->second));
+		toml::table toml_config = toml::parse(source);
 		return parse_tilemap(toml_config);
 	}
 	catch (const toml::parse_error& err) {
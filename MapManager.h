@@ -4,6 +4,7 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -81,6 +82,20 @@ struct Entity {
 	std::vector<Script> scripts;
 };
 
+// Throws out a short lived sprite every rate ticks.
+struct SpawnerConfig {
+	std::string spritesheet;
+	std::string sprite;
+	unsigned int x;
+	unsigned int y;
+	// ticks between particles
+	unsigned int rate;
+	// ticks each particle lives for
+	unsigned int lifetime;
+	// upwards, in pixels per tick
+	float speed;
+};
+
 struct LayerConfig {
 	float parallax;
 	// the w/h are computed from w/h of the map * parallax and rounded down
@@ -89,6 +104,7 @@ struct LayerConfig {
 	TileSetConfig tileset;
 	std::vector<TileConfig> tiles;
 	std::vector<Entity> entities;
+	std::vector<SpawnerConfig> spawners;
 };
 
 struct Map {
@@ -106,15 +122,40 @@ struct Map {
 	// entities
 };
 
-struct AnimatedTile {
-	unsigned int animation_frames;
-	unsigned int animation_rate;
-	unsigned int vert;
+// Tilemap layers are split into chunks this many tiles wide so only the
+// chunks overlapping the view need to be built, animated and drawn.
+const unsigned int TILEMAP_CHUNK_COLUMNS = 16;
 
-	float start_tx;
+// Where a tileset tile sits in the texture, all that is needed to build and animate its quad.
+struct TilemapTileFrame {
+	float tx;
 	float ty;
 	float width;
 	float height;
+	// set to 0 or 1 for no animation
+	unsigned int animation_frames;
+	// ticks per frame
+	unsigned int animation_rate;
+};
+
+struct TilemapChunkTile {
+	unsigned int x;
+	unsigned int y;
+	// index into CTilemapRenderLayer::frames
+	unsigned int frame;
+};
+
+struct TilemapChunk {
+	std::vector<TilemapChunkTile> tiles;
+	// empty until the chunk first comes near the view.
+	sf::VertexArray verts;
+	bool built;
+	// indices into tiles for the ones that animate.
+	std::vector<unsigned int> animated;
+	// the animation tick the texcoords were last set for.
+	unsigned int tick;
+
+	TilemapChunk() : tiles(), verts(sf::PrimitiveType::Quads), built(false), animated(), tick(0) {}
 };
 
 struct CTilemapParallaxLayer {
@@ -125,118 +166,47 @@ struct CTilemapParallaxLayer {
 
 void move_parallax_layer(Transform& t, const CTilemapParallaxLayer& pl, float camera_x, float camera_y);
 
+// The tiles of a layer and the quads built for them so far. The quads are a
+// render cache, not game state, so they live outside the component.
+struct TilemapLayerChunks {
+	std::vector<TilemapChunk> chunks;
+	std::vector<TilemapTileFrame> frames;
+};
+
 // A component that can be used in the ECS
+// Loading only sorts the tiles into chunks, a chunk's quads are built the
+// first time it comes near the view. Every copy of the component shares the
+// chunks, so the double buffered container only copies a pointer and the
+// animation tick when the layer changes.
 struct CTilemapRenderLayer {
 public:
-	sf::VertexArray verts;
+	std::shared_ptr<TilemapLayerChunks> layer;
+	float tile_width;
+	float tile_height;
 	sf::Texture* texture;
 	unsigned int animation_tick;
 	unsigned int ani_multiple;
-	std::vector<AnimatedTile> animated_tiles;
-
-	CTilemapRenderLayer() : verts(), texture(nullptr), animation_tick(0), ani_multiple(1) {}
-	CTilemapRenderLayer(const Map& map, unsigned int l, sf::Texture& t) :
-		verts(), texture(&t), animation_tick(0), ani_multiple(1)
-	{
-		const LayerConfig& layer = map.layers[l];
-		std::unordered_map<unsigned int, bool> ani_frames;
-		unsigned int tile_count = 0;
-		for (unsigned int i = 0; i < layer.tiles.size(); i++) {
-			if (layer.tiles[i].id > 0) {
-				tile_count++;
-
-				const TileSetTileConfig& tconf = layer.tileset.tiles[layer.tiles[i].id - 1];
-				if (tconf.animation_frames > 1 && tconf.animation_rate > 0) {
-					auto ticks = tconf.animation_frames * tconf.animation_rate;
-					ani_frames[ticks] = true;
-				}
-			}
-		}
-
-		// find the multiplier for the animation ticks
-		for (auto& it : ani_frames) {
-			ani_multiple = ani_multiple * it.first;
-		}
-
-		verts.setPrimitiveType(sf::PrimitiveType::Quads);
-		verts.resize(4 * tile_count);
-
-		float twidth = (float)map.tile_width;
-		float theight = (float)map.tile_height;
-
-		unsigned int vert = 0;
-		for (unsigned int i = 0; i < layer.tiles.size(); i++) {
-			const TileConfig& t = layer.tiles[i];
-			if (t.id <= 0) {
-				continue;
-			}
-			float x = (float)t.x * twidth;
-			float y = (float)t.y * theight;
-			float r = x + twidth;
-			float b = y + theight;
-
-			sf::Vertex* quad = &verts[vert];
-
-			quad[0].position = sf::Vector2f(x, y);
-			quad[1].position = sf::Vector2f(r, y);
-			quad[2].position = sf::Vector2f(r, b);
-			quad[3].position = sf::Vector2f(x, b);
-
-			const TileSetTileConfig& tconf = layer.tileset.tiles[t.id - 1];
-			float tx = (float)tconf.x;
-			float ty = (float)tconf.y;
-			float tr = tx + (float)tconf.width;
-			float tb = ty + (float)tconf.height;
-
-			quad[0].texCoords = sf::Vector2f(tx, ty);
-			quad[1].texCoords = sf::Vector2f(tr, ty);
-			quad[2].texCoords = sf::Vector2f(tr, tb);
-			quad[3].texCoords = sf::Vector2f(tx, tb);
-
-			if (tconf.animation_frames > 1 && tconf.animation_rate > 0) {
-				animated_tiles.push_back(
-					AnimatedTile{
-						tconf.animation_frames,
-						tconf.animation_rate,
-						vert,
-						tx, ty,
-						(float)tconf.width, (float)tconf.height
-					}
-				);
-			}
-			vert += 4;
-		}
-	}
-
-	void animate() {
-		animation_tick++;
-		if (animation_tick >= ani_multiple) {
-			animation_tick -= ani_multiple;
-		}
-
-		for (auto& t : animated_tiles) {
-			auto frame = (float)((animation_tick / t.animation_rate) % t.animation_frames);
-
-			sf::Vertex* quad = &verts[t.vert];
-
-			float tx = t.start_tx + (frame * t.width);
-			float ty = t.ty;
-			float tr = tx + t.width;
-			float tb = ty + t.height;
-
-			quad[0].texCoords = sf::Vector2f(tx, ty);
-			quad[1].texCoords = sf::Vector2f(tr, ty);
-			quad[2].texCoords = sf::Vector2f(tr, tb);
-			quad[3].texCoords = sf::Vector2f(tx, tb);
-		}
-	}
-
-	void render(sf::RenderTarget& target, const sf::Transform& transform) const {
-		sf::RenderStates states;
-		states.texture = texture;
-		states.transform = transform;
-		target.draw(verts, states);
-	}
+
+	CTilemapRenderLayer();
+	CTilemapRenderLayer(const Map& map, unsigned int l, sf::Texture& t);
+
+	// Advances the animation tick, the chunks catch up in refresh.
+	void animate();
+	// Builds, or catches up the animation of, the chunks within margin chunks of
+	// view. Only touches the shared chunks, so it works on the live component.
+	void refresh(const sf::Transform& transform, const sf::FloatRect& view, int margin) const;
+
+	// Draws the built chunks overlapping view. The view is in world space, so the
+	// parallax offset in transform is taken into account.
+	void render(sf::RenderTarget& target, const sf::Transform& transform, const sf::FloatRect& view) const;
+
+	size_t built_chunks() const;
+
+private:
+	// inclusive chunk range overlapping view, widened by margin chunks. first > last if none.
+	std::pair<int, int> _chunk_range(const sf::Transform& transform, const sf::FloatRect& view, int margin) const;
+	void _build(TilemapChunk& chunk) const;
+	void _animate(TilemapChunk& chunk) const;
 };
 
 class MapManager {
@@ -246,6 +216,10 @@ public:
 	bool load(std::string config_path);
 
 	std::optional<Map> get_level(std::string name);
+	// A level file that isn't in the level list, like a generated one.
+	std::optional<Map> load_level(std::string path);
+	// name is only used for errors.
+	std::optional<Map> parse_level(const std::string& source, const std::string& name);
 	std::vector<std::string> get_level_names() const;
 private:
 	std::shared_ptr<IFileManager> _file_manager;
@@ -260,6 +234,8 @@ private:
 	Script parse_script(toml::node_view<toml::node> n);
 	Entity parse_entity(toml::node_view<toml::node> n);
 	std::vector<Entity> parse_entities(toml::node_view<toml::node> n);
+	SpawnerConfig parse_spawner(toml::node_view<toml::node> n);
+	std::vector<SpawnerConfig> parse_spawners(toml::node_view<toml::node> n);
 	TileSetTileConfig parse_tileset_tile(toml::node_view<toml::node> tile_config);
 	TileSetConfig parse_tileset(toml::table config);
 	std::optional<TileSetConfig> load_tilesetfile(std::string path);
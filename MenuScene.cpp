@@ -6,8 +6,8 @@
 #include "GameScene.h"
 
 MenuScene::MenuScene() : _item_selected(0) {
-	RegisterActionSystem(&MenuScene::HandleInput);
-	RegisterRenderGUISystem(&MenuScene::RenderMenu);
+	RegisterActionSystem(&MenuScene::HandleInput, "HandleInput");
+	RegisterRenderGUISystem(&MenuScene::RenderMenu, "RenderMenu");
 }
 
 MenuScene::~MenuScene() {}
@@ -0,0 +1,391 @@
+#include "MicroBenchmark.h"
+
+#if !defined(MATTECS_GOOGLE_BENCHMARK)
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <thread>
+
+namespace {
+	const uint64_t MAX_ITERATIONS = 1000000000;
+
+	struct Options {
+		std::string filter = ".";
+		double min_time = 0.5;
+		std::string format = "console";
+		std::string out;
+		std::string out_format = "json";
+		bool list = false;
+		std::string executable;
+	};
+
+	struct Run {
+		std::string name;
+		uint64_t iterations;
+		// per iteration, in unit.
+		double time;
+		const char* unit;
+		double items_per_second;
+		double bytes_per_second;
+	};
+
+	Options options;
+	std::vector<std::unique_ptr<benchmark::Benchmark>> benchmarks;
+
+	const char* unit_name(benchmark::TimeUnit unit) {
+		switch (unit) {
+		case benchmark::kMicrosecond: return "us";
+		case benchmark::kMillisecond: return "ms";
+		case benchmark::kSecond: return "s";
+		default: return "ns";
+		}
+	}
+
+	double unit_scale(benchmark::TimeUnit unit) {
+		switch (unit) {
+		case benchmark::kMicrosecond: return 1e6;
+		case benchmark::kMillisecond: return 1e3;
+		case benchmark::kSecond: return 1.0;
+		default: return 1e9;
+		}
+	}
+
+	std::string run_name(const benchmark::Benchmark& b, const std::vector<int64_t>& args) {
+		std::string name = b.name();
+		for (auto arg : args) {
+			name += "/" + std::to_string(arg);
+		}
+		return name;
+	}
+
+	// Like Google Benchmark, grows the iterations until a run takes min_time.
+	Run measure(const benchmark::Benchmark& b, const std::vector<int64_t>& args) {
+		uint64_t iterations = 1;
+		while (true) {
+			benchmark::State state(args, iterations);
+			b.run(state);
+			double seconds = state.seconds();
+
+			if (seconds >= options.min_time || iterations >= MAX_ITERATIONS) {
+				Run run;
+				run.name = run_name(b, args);
+				run.iterations = iterations;
+				run.time = seconds / iterations * unit_scale(b.unit());
+				run.unit = unit_name(b.unit());
+				run.items_per_second = seconds > 0.0 ? state.items_processed() / seconds : 0.0;
+				run.bytes_per_second = seconds > 0.0 ? state.bytes_processed() / seconds : 0.0;
+				return run;
+			}
+
+			// aim a bit past min_time, but never more than 10x at once.
+			double multiplier = seconds > 0.0 ? options.min_time * 1.4 / seconds : 10.0;
+			multiplier = std::clamp(multiplier, 2.0, 10.0);
+			iterations = std::min<uint64_t>((uint64_t)(iterations * multiplier), MAX_ITERATIONS);
+		}
+	}
+
+	std::string json_escape(const std::string& s) {
+		std::string escaped;
+		for (char c : s) {
+			if (c == '"' || c == '\\') {
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	void write_console(std::ostream& out, const std::vector<Run>& runs) {
+		size_t width = 9;
+		for (const auto& run : runs) {
+			width = std::max(width, run.name.size());
+		}
+		out << std::left << std::setw(width) << "Benchmark" << std::right
+			<< std::setw(16) << "Time"
+			<< std::setw(14) << "Iterations"
+			<< std::setw(16) << "items/s" << "\n";
+		out << std::string(width + 46, '-') << "\n";
+		for (const auto& run : runs) {
+			std::ostringstream time;
+			time << std::fixed << std::setprecision(run.time < 10.0 ? 3 : 1) << run.time << " " << run.unit;
+			out << std::left << std::setw(width) << run.name << std::right
+				<< std::setw(16) << time.str()
+				<< std::setw(14) << run.iterations
+				<< std::setw(16) << std::scientific << std::setprecision(3) << run.items_per_second
+				<< std::defaultfloat << "\n";
+		}
+	}
+
+	// The parts of Google Benchmark's json that tools like compare.py read.
+	// There is no separate cpu clock, so cpu_time is the wall time.
+	void write_json(std::ostream& out, const std::vector<Run>& runs) {
+		std::time_t now = std::time(nullptr);
+		std::tm local;
+#if defined(_MSC_VER)
+		localtime_s(&local, &now);
+#else
+		localtime_r(&now, &local);
+#endif
+		char date[32];
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &local);
+
+		out << "{\n  \"context\": {\n"
+			<< "    \"date\": \"" << date << "\",\n"
+			<< "    \"executable\": \"" << json_escape(options.executable) << "\",\n"
+			<< "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#if defined(NDEBUG)
+			<< "    \"library_build_type\": \"release\"\n"
+#else
+			<< "    \"library_build_type\": \"debug\"\n"
+#endif
+			<< "  },\n  \"benchmarks\": [";
+		for (size_t i = 0; i < runs.size(); i++) {
+			const auto& run = runs[i];
+			out << (i > 0 ? ",\n" : "\n")
+				<< "    {\n"
+				<< "      \"name\": \"" << json_escape(run.name) << "\",\n"
+				<< "      \"run_name\": \"" << json_escape(run.name) << "\",\n"
+				<< "      \"run_type\": \"iteration\",\n"
+				<< "      \"iterations\": " << run.iterations << ",\n"
+				<< "      \"real_time\": " << std::setprecision(10) << run.time << ",\n"
+				<< "      \"cpu_time\": " << run.time << ",\n"
+				<< "      \"time_unit\": \"" << run.unit << "\"";
+			if (run.items_per_second > 0.0) {
+				out << ",\n      \"items_per_second\": " << run.items_per_second;
+			}
+			if (run.bytes_per_second > 0.0) {
+				out << ",\n      \"bytes_per_second\": " << run.bytes_per_second;
+			}
+			out << "\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	void write_csv(std::ostream& out, const std::vector<Run>& runs) {
+		out << "name,iterations,real_time,cpu_time,time_unit,bytes_per_second,items_per_second,label,error_occurred,error_message\n";
+		for (const auto& run : runs) {
+			out << "\"" << run.name << "\"," << run.iterations << ","
+				<< std::setprecision(10) << run.time << "," << run.time << "," << run.unit << ",";
+			if (run.bytes_per_second > 0.0) {
+				out << run.bytes_per_second;
+			}
+			out << ",";
+			if (run.items_per_second > 0.0) {
+				out << run.items_per_second;
+			}
+			out << ",,,\n";
+		}
+	}
+
+	void write(std::ostream& out, const std::string& format, const std::vector<Run>& runs) {
+		if (format == "json") {
+			write_json(out, runs);
+		}
+		else if (format == "csv") {
+			write_csv(out, runs);
+		}
+		else {
+			write_console(out, runs);
+		}
+	}
+
+	bool take_flag(const std::string& arg, const char* flag, std::string& value) {
+		std::string prefix = std::string("--") + flag + "=";
+		if (arg.compare(0, prefix.size(), prefix) != 0) {
+			return false;
+		}
+		value = arg.substr(prefix.size());
+		return true;
+	}
+}
+
+namespace benchmark {
+	namespace internal {
+		const void* volatile sink = nullptr;
+	}
+
+	State::State(const std::vector<int64_t>& args, uint64_t iterations) :
+		_args(args), _iterations(iterations), _running(false), _started(), _elapsed(0), _items(0), _bytes(0) {}
+
+	State::Iterator State::begin() {
+		_elapsed = std::chrono::steady_clock::duration(0);
+		_running = true;
+		_started = std::chrono::steady_clock::now();
+		return Iterator(this, _iterations);
+	}
+
+	State::Iterator State::end() {
+		return Iterator(this, 0);
+	}
+
+	int64_t State::range(size_t i) const {
+		return _args.at(i);
+	}
+
+	uint64_t State::iterations() const {
+		return _iterations;
+	}
+
+	void State::PauseTiming() {
+		if (_running) {
+			_elapsed += std::chrono::steady_clock::now() - _started;
+			_running = false;
+		}
+	}
+
+	void State::ResumeTiming() {
+		if (!_running) {
+			_running = true;
+			_started = std::chrono::steady_clock::now();
+		}
+	}
+
+	void State::SetItemsProcessed(int64_t items) {
+		_items = items;
+	}
+
+	void State::SetBytesProcessed(int64_t bytes) {
+		_bytes = bytes;
+	}
+
+	double State::seconds() const {
+		return std::chrono::duration<double>(_elapsed).count();
+	}
+
+	int64_t State::items_processed() const {
+		return _items;
+	}
+
+	int64_t State::bytes_processed() const {
+		return _bytes;
+	}
+
+	void State::_finish() {
+		PauseTiming();
+	}
+
+	Benchmark::Benchmark(const std::string& name, std::function<void(State&)> fn) : _name(name), _fn(fn), _unit(kNanosecond) {}
+
+	Benchmark* Benchmark::Arg(int64_t arg) {
+		_args.push_back({ arg });
+		return this;
+	}
+
+	Benchmark* Benchmark::Args(const std::vector<int64_t>& args) {
+		_args.push_back(args);
+		return this;
+	}
+
+	Benchmark* Benchmark::Unit(TimeUnit unit) {
+		_unit = unit;
+		return this;
+	}
+
+	const std::string& Benchmark::name() const {
+		return _name;
+	}
+
+	const std::vector<std::vector<int64_t>>& Benchmark::args() const {
+		return _args;
+	}
+
+	TimeUnit Benchmark::unit() const {
+		return _unit;
+	}
+
+	void Benchmark::run(State& state) const {
+		_fn(state);
+	}
+
+	Benchmark* RegisterBenchmark(const std::string& name, std::function<void(State&)> fn) {
+		benchmarks.push_back(std::make_unique<Benchmark>(name, fn));
+		return benchmarks.back().get();
+	}
+
+	void Initialize(int* argc, char** argv) {
+		options.executable = *argc > 0 ? argv[0] : "";
+		int kept = 1;
+		for (int i = 1; i < *argc; i++) {
+			std::string arg = argv[i];
+			std::string value;
+			if (take_flag(arg, "benchmark_filter", value)) {
+				options.filter = value;
+			}
+			else if (take_flag(arg, "benchmark_min_time", value)) {
+				// newer Google Benchmark wants a trailing s, take either.
+				options.min_time = std::strtod(value.c_str(), nullptr);
+			}
+			else if (take_flag(arg, "benchmark_format", value)) {
+				options.format = value;
+			}
+			else if (take_flag(arg, "benchmark_out", value)) {
+				options.out = value;
+			}
+			else if (take_flag(arg, "benchmark_out_format", value)) {
+				options.out_format = value;
+			}
+			else if (arg == "--benchmark_list_tests" || arg == "--benchmark_list_tests=true") {
+				options.list = true;
+			}
+			else {
+				argv[kept++] = argv[i];
+			}
+		}
+		*argc = kept;
+	}
+
+	bool ReportUnrecognizedArguments(int argc, char** argv) {
+		for (int i = 1; i < argc; i++) {
+			std::cerr << argv[0] << ": error: unrecognized command-line flag: " << argv[i] << "\n";
+		}
+		return argc > 1;
+	}
+
+	size_t RunSpecifiedBenchmarks() {
+		std::regex filter(options.filter);
+		std::vector<Run> runs;
+		for (const auto& b : benchmarks) {
+			std::vector<std::vector<int64_t>> all_args = b->args();
+			if (all_args.empty()) {
+				all_args.push_back({});
+			}
+			for (const auto& args : all_args) {
+				std::string name = run_name(*b, args);
+				if (!std::regex_search(name, filter)) {
+					continue;
+				}
+				if (options.list) {
+					std::cout << name << "\n";
+					continue;
+				}
+				runs.push_back(measure(*b, args));
+			}
+		}
+
+		if (options.list) {
+			return 0;
+		}
+		write(std::cout, options.format, runs);
+		if (!options.out.empty()) {
+			std::ofstream out(options.out, std::ios::trunc);
+			if (!out) {
+				std::cerr << "Failed to open " << options.out << "\n";
+			}
+			write(out, options.out_format, runs);
+		}
+		return runs.size();
+	}
+
+	void Shutdown() {
+		benchmarks.clear();
+	}
+}
+
+#endif
@@ -0,0 +1,129 @@
+#pragma once
+
+// Google Benchmark when MATTECS_GOOGLE_BENCHMARK is defined (see
+// ECSBenchmark.vcxproj), otherwise a small stand in for the part of its API
+// the benchmarks use. The stand in takes the same --benchmark_filter,
+// --benchmark_min_time, --benchmark_format, --benchmark_out and
+// --benchmark_out_format flags and writes the same json and csv, so results
+// from either can be compared with the same tools.
+#if defined(MATTECS_GOOGLE_BENCHMARK)
+
+#include <benchmark/benchmark.h>
+
+#else
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace benchmark {
+	enum TimeUnit { kNanosecond, kMicrosecond, kMillisecond, kSecond };
+
+	namespace internal {
+		extern const void* volatile sink;
+	}
+
+	// The compiler has to assume value is read, so whatever made it can't be
+	// optimised out.
+	template <typename T>
+	void DoNotOptimize(const T& value) {
+		internal::sink = &value;
+	}
+
+	// Memory writes before this can't be dropped or moved past it.
+	inline void ClobberMemory() {
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+	}
+
+	class State {
+	public:
+#if defined(__GNUC__)
+		struct __attribute__((unused)) Value {};
+#else
+		struct Value {};
+#endif
+
+		class Iterator {
+		public:
+			Iterator(State* state, uint64_t remaining) : _state(state), _remaining(remaining) {}
+			Value operator*() const { return Value(); }
+			Iterator& operator++() { _remaining--; return *this; }
+			// stops the clock when the last iteration is done.
+			bool operator!=(const Iterator&) {
+				if (_remaining > 0) {
+					return true;
+				}
+				_state->_finish();
+				return false;
+			}
+		private:
+			State* _state;
+			uint64_t _remaining;
+		};
+
+		State(const std::vector<int64_t>& args, uint64_t iterations);
+
+		Iterator begin();
+		Iterator end();
+
+		int64_t range(size_t i = 0) const;
+		uint64_t iterations() const;
+
+		// for setup inside the loop that shouldn't count.
+		void PauseTiming();
+		void ResumeTiming();
+
+		// turned into items/bytes per second of timed time.
+		void SetItemsProcessed(int64_t items);
+		void SetBytesProcessed(int64_t bytes);
+
+		double seconds() const;
+		int64_t items_processed() const;
+		int64_t bytes_processed() const;
+
+	private:
+		void _finish();
+
+		std::vector<int64_t> _args;
+		uint64_t _iterations;
+		bool _running;
+		std::chrono::steady_clock::time_point _started;
+		std::chrono::steady_clock::duration _elapsed;
+		int64_t _items;
+		int64_t _bytes;
+	};
+
+	class Benchmark {
+	public:
+		Benchmark(const std::string& name, std::function<void(State&)> fn);
+
+		// One run per Arg or Args call, the values show up in the name.
+		Benchmark* Arg(int64_t arg);
+		Benchmark* Args(const std::vector<int64_t>& args);
+		Benchmark* Unit(TimeUnit unit);
+
+		const std::string& name() const;
+		const std::vector<std::vector<int64_t>>& args() const;
+		TimeUnit unit() const;
+		void run(State& state) const;
+
+	private:
+		std::string _name;
+		std::function<void(State&)> _fn;
+		std::vector<std::vector<int64_t>> _args;
+		TimeUnit _unit;
+	};
+
+	Benchmark* RegisterBenchmark(const std::string& name, std::function<void(State&)> fn);
+
+	// Takes the --benchmark_ flags out of argv.
+	void Initialize(int* argc, char** argv);
+	bool ReportUnrecognizedArguments(int argc, char** argv);
+	size_t RunSpecifiedBenchmarks();
+	void Shutdown();
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "OverlapBatch.h"
+
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX2__)
+#define OVERLAP_BATCH_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OVERLAP_BATCH_SSE2
+#endif
+#if defined(OVERLAP_BATCH_AVX2) || defined(OVERLAP_BATCH_SSE2)
+#include <immintrin.h>
+#endif
+
+namespace {
+	// One candidate, written the same way as overlap() so the rounding matches.
+	bool overlap_one(float x, float y, float hw, float hh, float cx, float cy, float chw, float chh, float& pen_x, float& pen_y) {
+		float nx = x - cx;
+		float overlap_x = (hw + chw) - std::fabs(nx);
+		float ny = y - cy;
+		float overlap_y = (hh + chh) - std::fabs(ny);
+		if (overlap_x <= 0 || overlap_y <= 0) {
+			pen_x = 0.0f;
+			pen_y = 0.0f;
+			return false;
+		}
+		pen_x = nx < 0 ? -overlap_x : overlap_x;
+		pen_y = ny < 0 ? -overlap_y : overlap_y;
+		return true;
+	}
+}
+
+OverlapBatch::OverlapBatch() {}
+
+void OverlapBatch::clear() {
+	_x.clear();
+	_y.clear();
+	_half_w.clear();
+	_half_h.clear();
+}
+
+void OverlapBatch::add(const sf::Vector2f& position, const sf::Vector2f& half_size) {
+	_x.push_back(position.x);
+	_y.push_back(position.y);
+	_half_w.push_back(half_size.x);
+	_half_h.push_back(half_size.y);
+}
+
+size_t OverlapBatch::size() const {
+	return _x.size();
+}
+
+size_t OverlapBatch::test(const sf::Vector2f& position, const sf::Vector2f& half_size) {
+	size_t n = _x.size();
+	_hit.resize(n);
+	_pen_x.resize(n);
+	_pen_y.resize(n);
+
+	size_t hits = 0;
+	size_t i = 0;
+#ifdef OVERLAP_BATCH_AVX2
+	{
+		const __m256 x = _mm256_set1_ps(position.x);
+		const __m256 y = _mm256_set1_ps(position.y);
+		const __m256 hw = _mm256_set1_ps(half_size.x);
+		const __m256 hh = _mm256_set1_ps(half_size.y);
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		for (; i + 8 <= n; i += 8) {
+			__m256 nx = _mm256_sub_ps(x, _mm256_loadu_ps(&_x[i]));
+			__m256 ny = _mm256_sub_ps(y, _mm256_loadu_ps(&_y[i]));
+			__m256 ox = _mm256_sub_ps(_mm256_add_ps(hw, _mm256_loadu_ps(&_half_w[i])), _mm256_andnot_ps(sign, nx));
+			__m256 oy = _mm256_sub_ps(_mm256_add_ps(hh, _mm256_loadu_ps(&_half_h[i])), _mm256_andnot_ps(sign, ny));
+			__m256 hit = _mm256_and_ps(_mm256_cmp_ps(ox, zero, _CMP_GT_OQ), _mm256_cmp_ps(oy, zero, _CMP_GT_OQ));
+			// negative when the box is left of / above the candidate, zero on a miss.
+			ox = _mm256_xor_ps(ox, _mm256_and_ps(_mm256_cmp_ps(nx, zero, _CMP_LT_OQ), sign));
+			oy = _mm256_xor_ps(oy, _mm256_and_ps(_mm256_cmp_ps(ny, zero, _CMP_LT_OQ), sign));
+			_mm256_storeu_ps(&_pen_x[i], _mm256_and_ps(ox, hit));
+			_mm256_storeu_ps(&_pen_y[i], _mm256_and_ps(oy, hit));
+
+			unsigned int mask = (unsigned int)_mm256_movemask_ps(hit);
+			for (size_t lane = 0; lane < 8; lane++) {
+				_hit[i + lane] = (mask >> lane) & 1;
+			}
+			hits += std::popcount(mask);
+		}
+	}
+#endif
+#ifdef OVERLAP_BATCH_SSE2
+	{
+		const __m128 x = _mm_set1_ps(position.x);
+		const __m128 y = _mm_set1_ps(position.y);
+		const __m128 hw = _mm_set1_ps(half_size.x);
+		const __m128 hh = _mm_set1_ps(half_size.y);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+		for (; i + 4 <= n; i += 4) {
+			__m128 nx = _mm_sub_ps(x, _mm_loadu_ps(&_x[i]));
+			__m128 ny = _mm_sub_ps(y, _mm_loadu_ps(&_y[i]));
+			__m128 ox = _mm_sub_ps(_mm_add_ps(hw, _mm_loadu_ps(&_half_w[i])), _mm_andnot_ps(sign, nx));
+			__m128 oy = _mm_sub_ps(_mm_add_ps(hh, _mm_loadu_ps(&_half_h[i])), _mm_andnot_ps(sign, ny));
+			__m128 hit = _mm_and_ps(_mm_cmpgt_ps(ox, zero), _mm_cmpgt_ps(oy, zero));
+			ox = _mm_xor_ps(ox, _mm_and_ps(_mm_cmplt_ps(nx, zero), sign));
+			oy = _mm_xor_ps(oy, _mm_and_ps(_mm_cmplt_ps(ny, zero), sign));
+			_mm_storeu_ps(&_pen_x[i], _mm_and_ps(ox, hit));
+			_mm_storeu_ps(&_pen_y[i], _mm_and_ps(oy, hit));
+
+			unsigned int mask = (unsigned int)_mm_movemask_ps(hit);
+			for (size_t lane = 0; lane < 4; lane++) {
+				_hit[i + lane] = (mask >> lane) & 1;
+			}
+			hits += std::popcount(mask);
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		_hit[i] = overlap_one(position.x, position.y, half_size.x, half_size.y, _x[i], _y[i], _half_w[i], _half_h[i], _pen_x[i], _pen_y[i]);
+		hits += _hit[i];
+	}
+	return hits;
+}
+
+bool OverlapBatch::any(const sf::Vector2f& position, const sf::Vector2f& half_size) const {
+	size_t n = _x.size();
+	size_t i = 0;
+#ifdef OVERLAP_BATCH_AVX2
+	{
+		const __m256 x = _mm256_set1_ps(position.x);
+		const __m256 y = _mm256_set1_ps(position.y);
+		const __m256 hw = _mm256_set1_ps(half_size.x);
+		const __m256 hh = _mm256_set1_ps(half_size.y);
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		for (; i + 8 <= n; i += 8) {
+			__m256 ox = _mm256_sub_ps(_mm256_add_ps(hw, _mm256_loadu_ps(&_half_w[i])), _mm256_andnot_ps(sign, _mm256_sub_ps(x, _mm256_loadu_ps(&_x[i]))));
+			__m256 oy = _mm256_sub_ps(_mm256_add_ps(hh, _mm256_loadu_ps(&_half_h[i])), _mm256_andnot_ps(sign, _mm256_sub_ps(y, _mm256_loadu_ps(&_y[i]))));
+			if (_mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(ox, zero, _CMP_GT_OQ), _mm256_cmp_ps(oy, zero, _CMP_GT_OQ))) != 0) {
+				return true;
+			}
+		}
+	}
+#endif
+#ifdef OVERLAP_BATCH_SSE2
+	{
+		const __m128 x = _mm_set1_ps(position.x);
+		const __m128 y = _mm_set1_ps(position.y);
+		const __m128 hw = _mm_set1_ps(half_size.x);
+		const __m128 hh = _mm_set1_ps(half_size.y);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+		for (; i + 4 <= n; i += 4) {
+			__m128 ox = _mm_sub_ps(_mm_add_ps(hw, _mm_loadu_ps(&_half_w[i])), _mm_andnot_ps(sign, _mm_sub_ps(x, _mm_loadu_ps(&_x[i]))));
+			__m128 oy = _mm_sub_ps(_mm_add_ps(hh, _mm_loadu_ps(&_half_h[i])), _mm_andnot_ps(sign, _mm_sub_ps(y, _mm_loadu_ps(&_y[i]))));
+			if (_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(ox, zero), _mm_cmpgt_ps(oy, zero))) != 0) {
+				return true;
+			}
+		}
+	}
+#endif
+	float pen_x;
+	float pen_y;
+	for (; i < n; i++) {
+		if (overlap_one(position.x, position.y, half_size.x, half_size.y, _x[i], _y[i], _half_w[i], _half_h[i], pen_x, pen_y)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool OverlapBatch::hit(size_t i) const {
+	return _hit[i] != 0;
+}
+
+sf::Vector2f OverlapBatch::penetration(size_t i) const {
+	return sf::Vector2f(_pen_x[i], _pen_y[i]);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+// Candidate boxes gathered into columns so one box can be tested against all of
+// them at once, 8 at a time with AVX2, 4 with SSE2 and one by one otherwise.
+// Every path does the same float math as overlap(), so results don't depend on
+// which one was compiled in.
+class OverlapBatch {
+public:
+	OverlapBatch();
+
+	void clear();
+	void add(const sf::Vector2f& position, const sf::Vector2f& half_size);
+	size_t size() const;
+
+	// Tests the box against every candidate, hit(i) and penetration(i) then hold
+	// what overlap() would have returned for candidate i. Returns how many hit.
+	size_t test(const sf::Vector2f& position, const sf::Vector2f& half_size);
+	// true if the box overlaps any candidate, stops at the first block with a hit.
+	bool any(const sf::Vector2f& position, const sf::Vector2f& half_size) const;
+
+	bool hit(size_t i) const;
+	sf::Vector2f penetration(size_t i) const;
+
+private:
+	std::vector<float> _x;
+	std::vector<float> _y;
+	std::vector<float> _half_w;
+	std::vector<float> _half_h;
+	// results of the last test().
+	std::vector<uint8_t> _hit;
+	std::vector<float> _pen_x;
+	std::vector<float> _pen_y;
+};
@@ -0,0 +1,147 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+	uint32_t thread_index() {
+		static std::atomic<uint32_t> next(0);
+		thread_local uint32_t index = next++;
+		return index;
+	}
+
+	std::string json_escape(const std::string& s) {
+		std::string escaped;
+		for (char c : s) {
+			if (c == '"' || c == '\\') {
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+}
+
+Profiler::Scope::Scope(Profiler& profiler, uint32_t name) : _profiler(nullptr), _name(name), _start_us(0) {
+	if (profiler.enabled()) {
+		_profiler = &profiler;
+		_start_us = profiler.now_us();
+	}
+}
+
+Profiler::Scope::~Scope() {
+	if (_profiler) {
+		_profiler->add(_name, _start_us, _profiler->now_us() - _start_us);
+	}
+}
+
+Profiler::Profiler(size_t capacity) : _ring(capacity), _next(0), _tick(0), _enabled(false), _tracing(false), _start(std::chrono::steady_clock::now()) {}
+
+void Profiler::set_enabled(bool enabled) {
+	_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::enabled() const {
+	return _enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::set_tracing(bool tracing) {
+	_tracing = tracing;
+}
+
+bool Profiler::tracing() const {
+	return _tracing;
+}
+
+uint32_t Profiler::name_id(const std::string& name) {
+	auto found = _name_ids.find(name);
+	if (found != _name_ids.end()) {
+		return found->second;
+	}
+	uint32_t id = (uint32_t)_names.size();
+	_names.push_back(name);
+	_name_ids[name] = id;
+	return id;
+}
+
+const std::string& Profiler::name(uint32_t id) const {
+	return _names[id];
+}
+
+void Profiler::next_tick() {
+	_tick.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::tick() const {
+	return _tick.load(std::memory_order_relaxed);
+}
+
+int64_t Profiler::now_us() const {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+void Profiler::add(uint32_t name, int64_t start_us, int64_t duration_us) {
+	// every writer gets a slot of its own, the oldest sample is overwritten.
+	uint64_t index = _next.fetch_add(1, std::memory_order_relaxed);
+	_ring[index % _ring.size()] = Sample{ name, thread_index(), tick(), start_us, duration_us };
+}
+
+std::vector<Profiler::Sample> Profiler::samples() const {
+	uint64_t end = _next.load(std::memory_order_acquire);
+	uint64_t first = end > _ring.size() ? end - _ring.size() : 0;
+	std::vector<Sample> out;
+	out.reserve((size_t)(end - first));
+	for (uint64_t i = first; i < end; i++) {
+		out.push_back(_ring[i % _ring.size()]);
+	}
+	return out;
+}
+
+std::vector<std::pair<uint32_t, double>> Profiler::top(size_t n, uint64_t ticks) const {
+	uint64_t now = tick();
+	uint64_t oldest = now > ticks ? now - ticks : 0;
+	std::vector<int64_t> totals(_names.size(), 0);
+	for (const auto& sample : samples()) {
+		if (sample.tick > oldest && sample.name < totals.size()) {
+			totals[sample.name] += sample.duration_us;
+		}
+	}
+
+	std::vector<std::pair<uint32_t, double>> per_tick;
+	for (uint32_t i = 0; i < totals.size(); i++) {
+		if (totals[i] > 0) {
+			per_tick.emplace_back(i, (double)totals[i] / std::max<uint64_t>(ticks, 1));
+		}
+	}
+	std::sort(per_tick.begin(), per_tick.end(), [](const auto& a, const auto& b) {
+		return a.second > b.second;
+	});
+	if (per_tick.size() > n) {
+		per_tick.resize(n);
+	}
+	return per_tick;
+}
+
+bool Profiler::write_chrome_trace(const std::string& path) const {
+	std::ofstream out(path, std::ios::trunc);
+	if (!out) {
+		return false;
+	}
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (const auto& sample : samples()) {
+		if (!first) {
+			out << ",\n";
+		}
+		first = false;
+		// complete events, ts and dur are in microseconds.
+		out << "{\"name\":\"" << json_escape(_names[sample.name]) << "\""
+			<< ",\"ph\":\"X\",\"pid\":1"
+			<< ",\"tid\":" << sample.thread
+			<< ",\"ts\":" << sample.start_us
+			<< ",\"dur\":" << sample.duration_us
+			<< ",\"args\":{\"tick\":" << sample.tick << "}}";
+	}
+	out << "\n]}\n";
+	return (bool)out;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+const size_t PROFILER_CAPACITY = 1 << 16;
+
+// Scoped timers around systems and ECS bookkeeping. Samples go into a fixed
+// size ring, so profiling can stay on for a whole session and the last few
+// thousand ticks are always there to look at. Any thread can add samples
+// without taking a lock. Reading them back should happen between ticks, while
+// nothing is adding.
+class Profiler {
+public:
+	struct Sample {
+		uint32_t name;
+		// small per-thread number, 0 is whichever thread profiled first.
+		uint32_t thread;
+		uint64_t tick;
+		// since the profiler was made.
+		int64_t start_us;
+		int64_t duration_us;
+	};
+
+	// Times its own lifetime, does nothing while the profiler is off.
+	class Scope {
+	public:
+		Scope(Profiler& profiler, uint32_t name);
+		~Scope();
+	private:
+		Profiler* _profiler;
+		uint32_t _name;
+		int64_t _start_us;
+	};
+
+	explicit Profiler(size_t capacity = PROFILER_CAPACITY);
+
+	void set_enabled(bool enabled);
+	bool enabled() const;
+	// A trace is going to be written out, so only its owner turns recording off.
+	void set_tracing(bool tracing);
+	bool tracing() const;
+
+	// The same id every time for the same name. Not thread safe, look ids up
+	// before anything runs in parallel.
+	uint32_t name_id(const std::string& name);
+	const std::string& name(uint32_t id) const;
+
+	// Samples added from now on belong to the next tick.
+	void next_tick();
+	uint64_t tick() const;
+
+	int64_t now_us() const;
+	void add(uint32_t name, int64_t start_us, int64_t duration_us);
+
+	// what is still in the ring, oldest first.
+	std::vector<Sample> samples() const;
+	// The n names that took the most time per tick over the last ticks ticks,
+	// slowest first, in microseconds.
+	std::vector<std::pair<uint32_t, double>> top(size_t n, uint64_t ticks) const;
+
+	// Chrome trace event JSON, opens in chrome://tracing and Perfetto.
+	bool write_chrome_trace(const std::string& path) const;
+
+private:
+	std::vector<Sample> _ring;
+	// total samples ever added, the next one goes at _next % capacity.
+	std::atomic<uint64_t> _next;
+	std::atomic<uint64_t> _tick;
+	std::atomic<bool> _enabled;
+	bool _tracing;
+
+	std::vector<std::string> _names;
+	std::unordered_map<std::string, uint32_t> _name_ids;
+	std::chrono::steady_clock::time_point _start;
+};
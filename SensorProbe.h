@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "Components.h"
+#include "OverlapBatch.h"
+
+// The thin rects along each edge of a box used to fill in Sensors.
+// Each probe sticks out dist past the edge. Probes that already hit are
+// skipped, and done() is true once every edge has hit, so callers can
+// stop walking candidates early.
+struct SensorProbe {
+	sf::Vector2f position;
+	// covers all four probes, used to look up candidates.
+	sf::Vector2f bounds_half_size;
+	Sensors result;
+
+	SensorProbe(const sf::Vector2f& pos, const sf::Vector2f& half_size, float dist) :
+		position(pos),
+		bounds_half_size(half_size.x + dist, half_size.y + dist),
+		result(),
+		_h_size(dist, half_size.y),
+		_w_size(half_size.x, dist),
+		_left(pos.x - half_size.x, pos.y),
+		_right(pos.x + half_size.x, pos.y),
+		_top(pos.x, pos.y - half_size.y),
+		_bottom(pos.x, pos.y + half_size.y) {}
+
+	// Tests every solid box in the batch against the probes that have not hit
+	// yet. Returns true once all probes have hit.
+	bool test(const OverlapBatch& batch) {
+		if (!result.left && batch.any(_left, _h_size)) {
+			result.left = true;
+		}
+		if (!result.right && batch.any(_right, _h_size)) {
+			result.right = true;
+		}
+		if (!result.top && batch.any(_top, _w_size)) {
+			result.top = true;
+		}
+		if (!result.bottom && batch.any(_bottom, _w_size)) {
+			result.bottom = true;
+		}
+		return done();
+	}
+
+	bool done() const {
+		return result.left && result.right && result.top && result.bottom;
+	}
+
+private:
+	sf::Vector2f _h_size;
+	sf::Vector2f _w_size;
+	sf::Vector2f _left;
+	sf::Vector2f _right;
+	sf::Vector2f _top;
+	sf::Vector2f _bottom;
+};
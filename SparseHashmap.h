@@ -1,14 +1,28 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <algorithm>
 #include <iostream>
 #include <optional>
-#include <unordered_map>
+#include <type_traits>
 #include <vector>
 
+// Keys index straight into a paged sparse array of dense indices, so a lookup is
+// two array loads. Pages are only allocated once a key in them shows up, and
+// copying is a memcpy per page.
+//
+// Only the low SPARSE_SLOT_BITS of a key pick its slot, the rest must match the
+// stored key. That way the generation bits of an EntityID don't spread the pages
+// out, and a stale id for a reused slot is just missing. 20 bits leaves room for
+// a generation even when size_t is 32 bits.
+const size_t SPARSE_PAGE_SIZE = 1024;
+const size_t SPARSE_SLOT_BITS = 20;
+const size_t SPARSE_SLOT_MASK = ((size_t)1 << SPARSE_SLOT_BITS) - 1;
+
 template <typename K, typename V>
 class SparseHashmap {
+	static_assert(std::is_integral<K>::value, "SparseHashmap keys index an array, they must be integers");
 public:
     SparseHashmap() {
 	}
@@ -17,7 +31,7 @@ public:
 		_values.reserve(capacity);
 	}
     SparseHashmap(const SparseHashmap& to_copy) {
-		_key_to_index = to_copy._key_to_index;
+		_pages = to_copy._pages;
 		_keys = to_copy._keys;
 		_values = to_copy._values;
 	}
@@ -25,7 +39,7 @@ public:
     ~SparseHashmap() {}
 
 	SparseHashmap& operator=(const SparseHashmap& to_copy) {
-		_key_to_index = to_copy._key_to_index;
+		_pages = to_copy._pages;
 		_keys = to_copy._keys;
 		_values = to_copy._values;
 		return *this;
@@ -39,17 +53,19 @@ public:
 	}
 
 	bool has(const K& key) const {
-		return _key_to_index.find(key) != _key_to_index.end();
+		return _lookup(key) != NO_INDEX;
 	}
 	size_t index_of(const K& key) const {
-		return _key_to_index.at(key);
+		size_t index = _lookup(key);
+		assert(index != NO_INDEX);
+		return index;
 	}
-	std::optional<size_t> find_index_of(K& key) {
-		auto i = _key_to_index.find(key);
-		if (i == _key_to_index.end()) {
+	std::optional<size_t> find_index_of(const K& key) const {
+		size_t index = _lookup(key);
+		if (index == NO_INDEX) {
 			return {};
 		}
-		return i->second;
+		return index;
 	}
 
 	const K& key_at(size_t index) const {
@@ -58,50 +74,92 @@ public:
 	V& value_at(size_t index) {
 		return _values.at(index);
 	}
-	V& value_of(K& key) {
-		size_t index = _key_to_index.at(key);
-		return _values.at(index);
+	V& value_of(const K& key) {
+		return _values.at(index_of(key));
 	}
 
 	void add(const K& key, V& value) {
 		size_t index = _keys.size();
 		_keys.push_back(key);
 		_values.push_back(std::move(value));
-		_key_to_index[key] = index;
+		_set_index(key, index);
 	}
 	template <typename... Args>
 	void emplace(K& key, Args&&... args) {
 		size_t index = _keys.size();
 		_keys.push_back(key);
 		_values.emplace_back(std::forward<Args>(args)...);
-		_key_to_index[key] = index;
+		_set_index(key, index);
 	}
 
-	void remove(K& key) {
-		size_t index = _key_to_index[key];
+	void remove(const K& key) {
+		size_t index = index_of(key);
 		size_t last = _keys.size() - 1;
-		K& swap_key = _keys[last];
+		K removed = key;
 
-		// set the index first since swap_key changes (its a ref) after the swap.
-		_key_to_index[swap_key] = index;
 		// swap the back with the item deleted before removing entries.
+		_set_index(_keys[last], index);
 		std::swap(_keys[index], _keys[last]);
 		std::swap(_values[index], _values[last]);
 
 		_keys.pop_back();
 		_values.pop_back();
-		_key_to_index.erase(key);
+		_set_index(removed, NO_INDEX);
 	}
 
 	void apply_sort(const std::vector<size_t>& indices) {
 		_apply_vec_sort(_keys, indices);
 		_apply_vec_sort(_values, indices);
 		for (size_t i = 0; i < _keys.size(); i++) {
-			_key_to_index[_keys[i]] = i;
+			if (indices[i] != i) {
+				_set_index(_keys[i], i);
+			}
+		}
+	}
+
+	void swap_at(size_t a, size_t b) {
+		std::swap(_keys[a], _keys[b]);
+		std::swap(_values[a], _values[b]);
+		_set_index(_keys[a], a);
+		_set_index(_keys[b], b);
+	}
+
+	// Copies [first, last) over from other, which must hold the same keys.
+	void copy_range(const SparseHashmap& other, size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			_keys[i] = other._keys[i];
+			_values[i] = other._values[i];
+			_set_index(_keys[i], i);
 		}
 	}
 
 private:
+	static constexpr size_t NO_INDEX = SIZE_MAX;
+
+	size_t _lookup(const K& key) const {
+		size_t slot = (size_t)key & SPARSE_SLOT_MASK;
+		size_t page = slot / SPARSE_PAGE_SIZE;
+		if (page >= _pages.size() || _pages[page].empty()) {
+			return NO_INDEX;
+		}
+		size_t index = _pages[page][slot % SPARSE_PAGE_SIZE];
+		if (index == NO_INDEX || _keys[index] != key) {
+			return NO_INDEX;
+		}
+		return index;
+	}
+	void _set_index(const K& key, size_t index) {
+		size_t slot = (size_t)key & SPARSE_SLOT_MASK;
+		size_t page = slot / SPARSE_PAGE_SIZE;
+		if (page >= _pages.size()) {
+			_pages.resize(page + 1);
+		}
+		if (_pages[page].empty()) {
+			_pages[page].assign(SPARSE_PAGE_SIZE, NO_INDEX);
+		}
+		_pages[page][slot % SPARSE_PAGE_SIZE] = index;
+	}
+
 	template <typename V>
 	void _apply_vec_sort(std::vector<V>& tosort, const std::vector<size_t>& indices) {
 		std::vector<bool> sorted(tosort.size());
@@ -119,7 +177,8 @@ private:
 		}
 	}
 
-	std::unordered_map<K, size_t> _key_to_index;
+	// key -> index into _keys/_values, NO_INDEX if missing. Empty pages hold no keys.
+	std::vector<std::vector<size_t>> _pages;
 	std::vector<K> _keys;
 	std::vector<V> _values;
 };
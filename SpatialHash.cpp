@@ -0,0 +1,146 @@
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <cmath>
+
+SpatialHash::SpatialHash() : SpatialHash(16.0f, 16.0f) {}
+
+SpatialHash::SpatialHash(float cell_width, float cell_height) :
+	_cell_width(cell_width),
+	_cell_height(cell_height),
+	_stamp(0) {}
+
+void SpatialHash::clear() {
+	_entries.clear();
+	_cells.clear();
+}
+
+void SpatialHash::begin_sync() {
+	_stamp++;
+}
+
+void SpatialHash::update(MattECS::EntityID id, const sf::Vector2f& position, const sf::Vector2f& half_size) {
+	CellRange r = _range(position, half_size);
+
+	auto it = _entries.find(id);
+	if (it == _entries.end()) {
+		_entries[id] = Entry{ r, _stamp };
+		_insert(id, r);
+		return;
+	}
+
+	Entry& e = it->second;
+	e.stamp = _stamp;
+	if (e.cells == r) {
+		return;
+	}
+	_erase(id, e.cells);
+	_insert(id, r);
+	e.cells = r;
+}
+
+void SpatialHash::end_sync() {
+	for (auto it = _entries.begin(); it != _entries.end();) {
+		if (it->second.stamp != _stamp) {
+			_erase(it->first, it->second.cells);
+			it = _entries.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void SpatialHash::remove(MattECS::EntityID id) {
+	auto it = _entries.find(id);
+	if (it == _entries.end()) {
+		return;
+	}
+	_erase(id, it->second.cells);
+	_entries.erase(it);
+}
+
+void SpatialHash::query(const sf::Vector2f& position, const sf::Vector2f& half_size, std::vector<MattECS::EntityID>& out) const {
+	visit(position, half_size, [&out](MattECS::EntityID id) {
+		out.push_back(id);
+		return false;
+	});
+}
+
+void SpatialHash::pairs(std::vector<Pair>& out) const {
+	size_t start = out.size();
+	for (const auto& cell : _cells) {
+		const std::vector<CellItem>& items = cell.second;
+		if (items.size() < 2) {
+			continue;
+		}
+		int x = (int)(cell.first >> 32);
+		int y = (int)(int32_t)(cell.first & 0xffffffff);
+
+		for (size_t i = 0; i < items.size(); i++) {
+			const CellItem& a = items[i];
+			for (size_t j = i + 1; j < items.size(); j++) {
+				const CellItem& b = items[j];
+				if (x != std::max(a.min_x, b.min_x) || y != std::max(a.min_y, b.min_y)) {
+					continue;
+				}
+				if (a.id < b.id) {
+					out.push_back(std::make_pair(a.id, b.id));
+				}
+				else {
+					out.push_back(std::make_pair(b.id, a.id));
+				}
+			}
+		}
+	}
+	// the cell map has no meaningful order, so sort to keep resolution order stable.
+	std::sort(out.begin() + start, out.end());
+}
+
+size_t SpatialHash::size() const {
+	return _entries.size();
+}
+
+SpatialHash::CellRange SpatialHash::_range(const sf::Vector2f& position, const sf::Vector2f& half_size) const {
+	return CellRange{
+		(int)std::floor((position.x - half_size.x) / _cell_width),
+		(int)std::floor((position.y - half_size.y) / _cell_height),
+		(int)std::floor((position.x + half_size.x) / _cell_width),
+		(int)std::floor((position.y + half_size.y) / _cell_height)
+	};
+}
+
+int64_t SpatialHash::_key(int x, int y) const {
+	return ((int64_t)x << 32) | (int64_t)(uint32_t)y;
+}
+
+void SpatialHash::_insert(MattECS::EntityID id, const CellRange& r) {
+	for (int y = r.min_y; y <= r.max_y; y++) {
+		for (int x = r.min_x; x <= r.max_x; x++) {
+			_cells[_key(x, y)].push_back(CellItem{ id, r.min_x, r.min_y });
+		}
+	}
+}
+
+void SpatialHash::_erase(MattECS::EntityID id, const CellRange& r) {
+	for (int y = r.min_y; y <= r.max_y; y++) {
+		for (int x = r.min_x; x <= r.max_x; x++) {
+			auto cell = _cells.find(_key(x, y));
+			if (cell == _cells.end()) {
+				continue;
+			}
+			auto& items = cell->second;
+			for (size_t i = 0; i < items.size(); i++) {
+				if (items[i].id == id) {
+					std::swap(items[i], items.back());
+					items.pop_back();
+					break;
+				}
+			}
+			// pairs() walks every cell, so only keep the occupied ones.
+			if (items.empty()) {
+				_cells.erase(cell);
+			}
+		}
+	}
+}
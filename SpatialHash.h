@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "EntityManager.h"
+
+// A uniform grid broadphase keyed on the cell size (normally the tile size).
+// Each entity is bucketed into every cell its box touches. Moving an entity
+// only touches the buckets when the range of covered cells actually changes,
+// so most ticks are a compare and nothing else.
+//
+// Results are candidates only, the narrowphase still has to check overlap.
+class SpatialHash {
+public:
+	typedef std::pair<MattECS::EntityID, MattECS::EntityID> Pair;
+
+	SpatialHash();
+	SpatialHash(float cell_width, float cell_height);
+
+	void clear();
+
+	// Sync the hash with the current boxes. Call begin_sync, then update for
+	// every live box, then end_sync to drop entities that were not updated.
+	void begin_sync();
+	void update(MattECS::EntityID id, const sf::Vector2f& position, const sf::Vector2f& half_size);
+	void end_sync();
+
+	void remove(MattECS::EntityID id);
+
+	// Appends every entity sharing a cell with the box. Each entity is appended once.
+	void query(const sf::Vector2f& position, const sf::Vector2f& half_size, std::vector<MattECS::EntityID>& out) const;
+	// Calls f(id) for every entity sharing a cell with the box, each entity once.
+	// Stops and returns true as soon as f returns true.
+	template <typename F>
+	bool visit(const sf::Vector2f& position, const sf::Vector2f& half_size, F&& f) const;
+	// Appends every pair of entities sharing at least one cell, each pair once
+	// with the lower id first. The output is sorted so the order is stable.
+	void pairs(std::vector<Pair>& out) const;
+
+	size_t size() const;
+
+private:
+	struct CellRange {
+		int min_x;
+		int min_y;
+		int max_x;
+		int max_y;
+
+		bool operator==(const CellRange& o) const {
+			return min_x == o.min_x && min_y == o.min_y && max_x == o.max_x && max_y == o.max_y;
+		}
+	};
+	struct Entry {
+		CellRange cells;
+		unsigned int stamp;
+	};
+	// A cell holds the min cell of each item. When two ranges share several cells
+	// the pair (or query hit) is only reported from the top-left shared cell,
+	// which removes duplicates without any extra bookkeeping.
+	struct CellItem {
+		MattECS::EntityID id;
+		int min_x;
+		int min_y;
+	};
+
+	CellRange _range(const sf::Vector2f& position, const sf::Vector2f& half_size) const;
+	int64_t _key(int x, int y) const;
+	void _insert(MattECS::EntityID id, const CellRange& r);
+	void _erase(MattECS::EntityID id, const CellRange& r);
+
+	float _cell_width;
+	float _cell_height;
+	unsigned int _stamp;
+
+	std::unordered_map<MattECS::EntityID, Entry> _entries;
+	std::unordered_map<int64_t, std::vector<CellItem>> _cells;
+};
+
+template <typename F>
+bool SpatialHash::visit(const sf::Vector2f& position, const sf::Vector2f& half_size, F&& f) const {
+	CellRange r = _range(position, half_size);
+	for (int y = r.min_y; y <= r.max_y; y++) {
+		for (int x = r.min_x; x <= r.max_x; x++) {
+			auto cell = _cells.find(_key(x, y));
+			if (cell == _cells.end()) {
+				continue;
+			}
+			for (const CellItem& item : cell->second) {
+				if (x != std::max(r.min_x, item.min_x) || y != std::max(r.min_y, item.min_y)) {
+					continue;
+				}
+				if (f(item.id)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
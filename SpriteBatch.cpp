@@ -0,0 +1,92 @@
+#include "SpriteBatch.h"
+
+#include <algorithm>
+
+SpriteBatch::SpriteBatch() : _draw_calls(0) {}
+
+void SpriteBatch::clear() {
+	for (auto& b : _buckets) {
+		b.verts.clear();
+	}
+	_layers.clear();
+}
+
+void SpriteBatch::set_view(const sf::FloatRect& view) {
+	_view = view;
+}
+
+void SpriteBatch::add(int z, const Sprite& sprite, const sf::Transform& transform) {
+	sf::Transform t = transform;
+	t.translate(sprite.origin);
+
+	// Sprite stores its verts as a triangle strip, quads go around the edge instead.
+	const size_t strip_to_quad[4] = { 0, 2, 3, 1 };
+	sf::Vector2f points[4];
+	for (size_t i = 0; i < 4; i++) {
+		points[i] = t.transformPoint(sprite.va[strip_to_quad[i]].position);
+	}
+
+	float left = std::min(std::min(points[0].x, points[1].x), std::min(points[2].x, points[3].x));
+	float right = std::max(std::max(points[0].x, points[1].x), std::max(points[2].x, points[3].x));
+	float top = std::min(std::min(points[0].y, points[1].y), std::min(points[2].y, points[3].y));
+	float bottom = std::max(std::max(points[0].y, points[1].y), std::max(points[2].y, points[3].y));
+	if (right < _view.left || left > _view.left + _view.width || bottom < _view.top || top > _view.top + _view.height) {
+		return;
+	}
+
+	auto key = std::make_pair(z, (const sf::Texture*)sprite.t);
+	auto found = _bucket_location.find(key);
+	size_t index;
+	if (found == _bucket_location.end()) {
+		index = _buckets.size();
+		_buckets.push_back(Bucket{ z, sprite.t, sf::VertexArray(sf::PrimitiveType::Quads) });
+		_bucket_location[key] = index;
+	}
+	else {
+		index = found->second;
+	}
+
+	sf::VertexArray& verts = _buckets[index].verts;
+	for (size_t i = 0; i < 4; i++) {
+		verts.append(sf::Vertex(points[i], sprite.va[strip_to_quad[i]].texCoords));
+	}
+}
+
+void SpriteBatch::add(int z, const CTilemapRenderLayer& layer, const sf::Transform& transform) {
+	_layers.push_back(LayerDraw{ z, &layer, transform });
+}
+
+void SpriteBatch::draw(sf::RenderTarget& target) {
+	_draw_calls = 0;
+
+	// layers sharing a z keep the order they were added in.
+	std::stable_sort(_layers.begin(), _layers.end(), [](const LayerDraw& a, const LayerDraw& b) {
+		return a.z < b.z;
+	});
+
+	auto layer = _layers.begin();
+	for (auto& it : _bucket_location) {
+		const Bucket& bucket = _buckets[it.second];
+		if (bucket.verts.getVertexCount() == 0) {
+			continue;
+		}
+
+		for (; layer != _layers.end() && layer->z <= bucket.z; ++layer) {
+			layer->layer->render(target, layer->transform, _view);
+			_draw_calls++;
+		}
+
+		sf::RenderStates states;
+		states.texture = bucket.texture;
+		target.draw(bucket.verts, states);
+		_draw_calls++;
+	}
+	for (; layer != _layers.end(); ++layer) {
+		layer->layer->render(target, layer->transform, _view);
+		_draw_calls++;
+	}
+}
+
+size_t SpriteBatch::draw_calls() const {
+	return _draw_calls;
+}
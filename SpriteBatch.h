@@ -0,0 +1,57 @@
+#pragma once
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Components.h"
+#include "MapManager.h"
+
+// Collects sprites into one vertex array per (z, texture) and draws them in
+// z order, so every bucket is a single draw call no matter how many sprites.
+// Sprite transforms are applied on the CPU as the quads are appended.
+//
+// Tilemap layers already have their own vertex arrays, they are queued by z
+// and drawn before the sprites sharing the same z.
+//
+// Anything outside of the view is dropped, so callers only need a coarse cull.
+class SpriteBatch {
+public:
+	SpriteBatch();
+
+	// Empties every bucket but keeps the memory around for the next frame.
+	void clear();
+	// Sprites and tilemap chunks outside of view (in world space) are skipped.
+	void set_view(const sf::FloatRect& view);
+
+	void add(int z, const Sprite& sprite, const sf::Transform& transform);
+	void add(int z, const CTilemapRenderLayer& layer, const sf::Transform& transform);
+
+	void draw(sf::RenderTarget& target);
+
+	// number of draw calls the last draw() made.
+	size_t draw_calls() const;
+
+private:
+	struct Bucket {
+		int z;
+		const sf::Texture* texture;
+		sf::VertexArray verts;
+	};
+	struct LayerDraw {
+		int z;
+		const CTilemapRenderLayer* layer;
+		sf::Transform transform;
+	};
+
+	// there exists one vert array for each z + spritesheet (texture ptr).
+	std::vector<Bucket> _buckets;
+	// where in the above array a bucket exists. This is ordered by z first,
+	// which gives us the draw order for free.
+	std::map<std::pair<int, const sf::Texture*>, size_t> _bucket_location;
+	std::vector<LayerDraw> _layers;
+	sf::FloatRect _view;
+	size_t _draw_calls;
+};
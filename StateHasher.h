@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// FNV-1a over whatever values are fed in. Scenes use it to fingerprint their
+// simulation state after every tick, so a replay can tell where it diverged.
+class StateHasher {
+public:
+	StateHasher() : _hash(14695981039346656037ull) {}
+
+	void add(uint64_t v) {
+		for (int i = 0; i < 8; i++) {
+			_hash ^= (v >> (i * 8)) & 0xff;
+			_hash *= 1099511628211ull;
+		}
+	}
+	void add(int v) {
+		add((uint64_t)(int64_t)v);
+	}
+	// by bits, so -0.0 and 0.0 hash differently.
+	void add(float v) {
+		uint32_t bits;
+		std::memcpy(&bits, &v, sizeof(bits));
+		add((uint64_t)bits);
+	}
+
+	uint64_t value() const {
+		return _hash;
+	}
+
+private:
+	uint64_t _hash;
+};
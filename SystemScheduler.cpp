@@ -0,0 +1,98 @@
+#include "SystemScheduler.h"
+
+#include <algorithm>
+
+bool SystemAccess::conflicts(const SystemAccess& other) const {
+	if (_exclusive || other._exclusive) {
+		return true;
+	}
+	return _overlap(_writes, other._writes)
+		|| _overlap(_writes, other._reads)
+		|| _overlap(_reads, other._writes);
+}
+
+bool SystemAccess::empty() const {
+	return !_exclusive && _reads.empty() && _writes.empty();
+}
+
+bool SystemAccess::_overlap(const std::vector<size_t>& a, const std::vector<size_t>& b) {
+	for (auto c : a) {
+		if (std::find(b.begin(), b.end(), c) != b.end()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+SystemScheduler::SystemScheduler() : _parallel(false) {}
+
+size_t SystemScheduler::add(const SystemAccess& access) {
+	size_t index = _access.size();
+	_access.push_back(access);
+	_dependents.emplace_back();
+	_dependencies.push_back(0);
+	_after.emplace_back(index, false);
+
+	for (size_t i = 0; i < index; i++) {
+		if (_access[i].conflicts(access)) {
+			_dependents[i].push_back(index);
+			_dependencies[index]++;
+			_after[index][i] = true;
+			for (size_t j = 0; j < i; j++) {
+				if (_after[i][j]) {
+					_after[index][j] = true;
+				}
+			}
+		}
+	}
+	if (_dependencies[index] == 0) {
+		_roots.push_back(index);
+	}
+	// the stubs with nothing to do can overlap anything, that alone doesn't
+	// pay for handing them to other threads.
+	if (!access.empty()) {
+		for (size_t i = 0; i < index; i++) {
+			if (!_after[index][i] && !_access[i].empty()) {
+				_parallel = true;
+			}
+		}
+	}
+
+	_remaining.reset(new std::atomic<size_t>[_access.size()]);
+	return index;
+}
+
+size_t SystemScheduler::size() const {
+	return _access.size();
+}
+
+void SystemScheduler::run(const std::function<void(size_t)>& system) {
+	// a chain, no point in handing it to other threads.
+	if (!_parallel) {
+		for (size_t i = 0; i < _access.size(); i++) {
+			system(i);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < _access.size(); i++) {
+		_remaining[i] = _dependencies[i];
+	}
+	ThreadPool::Group group;
+	for (auto root : _roots) {
+		_start(root, group, system);
+	}
+	ThreadPool::shared().wait(group);
+}
+
+void SystemScheduler::_start(size_t index, ThreadPool::Group& group, const std::function<void(size_t)>& system) {
+	ThreadPool::shared().submit(group, [this, index, &group, &system]() {
+		system(index);
+		// queued before this job counts as finished, so the group can't finish early.
+		for (auto d : _dependents[index]) {
+			if (--_remaining[d] == 0) {
+				_start(d, group, system);
+			}
+		}
+	});
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "EntityManager.h"
+#include "ThreadPool.h"
+
+// The components a system reads and writes. Two systems can run at the same
+// time when neither writes anything the other one touches.
+//
+// mut() and queries only touch the containers involved, but adding or removing
+// components or entities goes through shared bookkeeping. Systems doing that,
+// or touching any other shared state, have to be exclusive. So do systems
+// sharing a View with another system, a View updates itself on first use.
+class SystemAccess {
+public:
+	SystemAccess() : _exclusive(false) {}
+
+	// Runs alone, after every system before it and before every system after it.
+	static SystemAccess exclusive() {
+		SystemAccess access;
+		access._exclusive = true;
+		return access;
+	}
+
+	template <typename... C>
+	SystemAccess& reads() {
+		(_reads.push_back(MattECS::component_type_id<C>), ...);
+		return *this;
+	}
+	template <typename... C>
+	SystemAccess& writes() {
+		(_writes.push_back(MattECS::component_type_id<C>), ...);
+		return *this;
+	}
+
+	bool conflicts(const SystemAccess& other) const;
+	// declares no components and isn't exclusive, nothing worth a thread.
+	bool empty() const;
+
+private:
+	static bool _overlap(const std::vector<size_t>& a, const std::vector<size_t>& b);
+
+	bool _exclusive;
+	std::vector<size_t> _reads;
+	std::vector<size_t> _writes;
+};
+
+// Runs a list of systems as a dependency graph. Each system waits for every
+// system registered before it that it conflicts with, anything else is free to
+// run on the thread pool next to it. Systems that run side by side never write
+// anything the other touches, as long as their SystemAccess is honest. Only
+// worth it when two systems that aren't empty() can overlap, otherwise run()
+// just calls them in order.
+class SystemScheduler {
+public:
+	SystemScheduler();
+
+	// returns the index run() will be called with for this system.
+	size_t add(const SystemAccess& access);
+	size_t size() const;
+
+	// Calls system(i) for every system and returns once all of them finished.
+	void run(const std::function<void(size_t)>& system);
+
+private:
+	void _start(size_t index, ThreadPool::Group& group, const std::function<void(size_t)>& system);
+
+	std::vector<SystemAccess> _access;
+	// systems waiting on each system.
+	std::vector<std::vector<size_t>> _dependents;
+	std::vector<size_t> _dependencies;
+	std::vector<size_t> _roots;
+	// every system each system waits on, directly or through others.
+	std::vector<std::vector<bool>> _after;
+	// dependencies left during a run.
+	std::unique_ptr<std::atomic<size_t>[]> _remaining;
+	// false until two systems that aren't empty() could run at the same time.
+	bool _parallel;
+};
@@ -0,0 +1,84 @@
+#include "SystemTimings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+SystemTimings::SystemTimings() {}
+
+void SystemTimings::reset(const std::vector<std::string>& names) {
+	_names = names;
+	_samples.clear();
+	_samples.resize(names.size());
+	_ticks.clear();
+}
+
+size_t SystemTimings::size() const {
+	return _names.size();
+}
+
+const std::string& SystemTimings::name(size_t system) const {
+	return _names[system];
+}
+
+void SystemTimings::add(size_t system, int64_t us) {
+	_samples[system].push_back(us);
+}
+
+void SystemTimings::add_tick(int64_t us) {
+	_ticks.push_back(us);
+}
+
+size_t SystemTimings::ticks() const {
+	return _ticks.size();
+}
+
+int64_t SystemTimings::percentile(size_t system, double p) {
+	return _percentile(_samples[system], p);
+}
+
+int64_t SystemTimings::tick_percentile(double p) {
+	return _percentile(_ticks, p);
+}
+
+void SystemTimings::report(std::ostream& out) {
+	size_t width = 4;
+	for (const auto& name : _names) {
+		width = std::max(width, name.size());
+	}
+	out << std::left << std::setw(width) << "system" << std::right
+		<< std::setw(10) << "mean us"
+		<< std::setw(10) << "p50"
+		<< std::setw(10) << "p90"
+		<< std::setw(10) << "p99"
+		<< std::setw(10) << "max" << "\n";
+	for (size_t i = 0; i < _names.size(); i++) {
+		out << std::left << std::setw(width) << _names[i] << std::right;
+		_report_row(out, _samples[i]);
+	}
+	out << std::left << std::setw(width) << "tick" << std::right;
+	_report_row(out, _ticks);
+}
+
+int64_t SystemTimings::_percentile(std::vector<int64_t>& samples, double p) {
+	if (samples.empty()) {
+		return 0;
+	}
+	std::sort(samples.begin(), samples.end());
+	// nearest rank.
+	size_t rank = (size_t)std::ceil(p / 100.0 * samples.size());
+	return samples[std::clamp(rank, (size_t)1, samples.size()) - 1];
+}
+
+void SystemTimings::_report_row(std::ostream& out, std::vector<int64_t>& samples) {
+	int64_t total = 0;
+	for (auto us : samples) {
+		total += us;
+	}
+	double mean = samples.empty() ? 0.0 : (double)total / samples.size();
+	out << std::setw(10) << std::fixed << std::setprecision(1) << mean
+		<< std::setw(10) << _percentile(samples, 50)
+		<< std::setw(10) << _percentile(samples, 90)
+		<< std::setw(10) << _percentile(samples, 99)
+		<< std::setw(10) << _percentile(samples, 100) << "\n";
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// How long every FixedUpdate system took on every tick, in microseconds, and
+// how long the ticks took as a whole. Meant for benchmark runs: every sample is
+// kept so the percentiles at the end are exact.
+class SystemTimings {
+public:
+	SystemTimings();
+
+	// Starts over with one column per system, named in registration order.
+	void reset(const std::vector<std::string>& names);
+	size_t size() const;
+	const std::string& name(size_t system) const;
+
+	// Systems can run at the same time, but each one only ever adds to its own
+	// column from one thread at a time.
+	void add(size_t system, int64_t us);
+	void add_tick(int64_t us);
+	size_t ticks() const;
+
+	// p in [0, 100], 0 if there are no samples. Sorts the column.
+	int64_t percentile(size_t system, double p);
+	int64_t tick_percentile(double p);
+
+	// mean, p50, p90, p99 and max of every system and of the whole tick.
+	void report(std::ostream& out);
+
+private:
+	static int64_t _percentile(std::vector<int64_t>& samples, double p);
+	static void _report_row(std::ostream& out, std::vector<int64_t>& samples);
+
+	std::vector<std::string> _names;
+	std::vector<std::vector<int64_t>> _samples;
+	std::vector<int64_t> _ticks;
+};
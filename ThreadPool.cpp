@@ -0,0 +1,73 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t workers) : _stopping(false) {
+	for (size_t i = 0; i < workers; i++) {
+		_threads.emplace_back(&ThreadPool::_work, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_changed.notify_all();
+	for (auto& t : _threads) {
+		t.join();
+	}
+}
+
+void ThreadPool::submit(Group& group, std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		group._pending++;
+		_jobs.push_back(Job{ &group, std::move(job) });
+	}
+	_changed.notify_all();
+}
+
+void ThreadPool::wait(Group& group) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (group._pending > 0) {
+		if (!_jobs.empty()) {
+			Job job = std::move(_jobs.front());
+			_jobs.pop_front();
+			_run(lock, job);
+		}
+		else {
+			_changed.wait(lock);
+		}
+	}
+}
+
+size_t ThreadPool::workers() const {
+	return _threads.size();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+	return pool;
+}
+
+void ThreadPool::_work() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_changed.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+		if (_jobs.empty()) {
+			return;
+		}
+		Job job = std::move(_jobs.front());
+		_jobs.pop_front();
+		_run(lock, job);
+	}
+}
+
+void ThreadPool::_run(std::unique_lock<std::mutex>& lock, Job& job) {
+	lock.unlock();
+	job.f();
+	lock.lock();
+	job.group->_pending--;
+	if (job.group->_pending == 0) {
+		_changed.notify_all();
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads pulling jobs off one queue. Jobs are submitted
+// into a Group and whoever waits on the group helps run queued jobs until the
+// group is done, so a job may itself submit and wait without deadlocking.
+class ThreadPool {
+public:
+	// Jobs that are waited on together.
+	class Group {
+	public:
+		Group() : _pending(0) {}
+	private:
+		friend class ThreadPool;
+		size_t _pending;
+	};
+
+	// workers == 0 runs every job on the thread that waits for it.
+	explicit ThreadPool(size_t workers);
+	~ThreadPool();
+
+	void submit(Group& group, std::function<void()> job);
+	// Runs queued jobs on this thread until every job in group has finished.
+	void wait(Group& group);
+
+	size_t workers() const;
+
+	// One worker per core besides the main thread. Started on first use.
+	static ThreadPool& shared();
+
+private:
+	struct Job {
+		Group* group;
+		std::function<void()> f;
+	};
+
+	void _work();
+	// runs job, lock must be held and is held again on return.
+	void _run(std::unique_lock<std::mutex>& lock, Job& job);
+
+	std::vector<std::thread> _threads;
+	std::deque<Job> _jobs;
+	std::mutex _mutex;
+	// signalled when a job is queued or a group finishes, waiters and idle
+	// workers both sleep on it.
+	std::condition_variable _changed;
+	bool _stopping;
+};
@@ -0,0 +1,178 @@
+#include "TileCollisionGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// tiles can only be merged if they would behave the same when hit.
+	bool same_collider(const TileSetTileConfig* a, const TileSetTileConfig* b) {
+		if (a == nullptr || b == nullptr) {
+			return a == b;
+		}
+		return a->passage == b->passage
+			&& a->damage == b->damage
+			&& a->hardness == b->hardness
+			&& a->piercing == b->piercing;
+	}
+
+	// a merged rect in tile coordinates, inclusive on both ends.
+	struct TileRect {
+		unsigned int x0;
+		unsigned int y0;
+		unsigned int x1;
+		unsigned int y1;
+		const TileSetTileConfig* tconf;
+	};
+
+	struct TileRun {
+		unsigned int x0;
+		unsigned int x1;
+		size_t rect;
+	};
+}
+
+TileCollisionGrid::TileCollisionGrid() :
+	_width(0),
+	_height(0),
+	_tile_width(0.0f),
+	_tile_height(0.0f),
+	_overhang(0),
+	_query_mark(0) {}
+
+TileCollisionGrid::TileCollisionGrid(const Map& map, unsigned int layer) :
+	_width(map.width),
+	_height(map.height),
+	_tile_width((float)map.tile_width),
+	_tile_height((float)map.tile_height),
+	_overhang(0),
+	_query_mark(0)
+{
+	_bake(map.layers[layer]);
+}
+
+void TileCollisionGrid::query(const sf::Vector2f& position, const sf::Vector2f& half_size, std::vector<size_t>& out) const {
+	visit(position, half_size, [&out](size_t index) {
+		out.push_back(index);
+		return false;
+	});
+}
+
+size_t TileCollisionGrid::size() const {
+	return _colliders.size();
+}
+
+const StaticCollider& TileCollisionGrid::collider(size_t index) const {
+	return _colliders[index];
+}
+
+StaticCollider& TileCollisionGrid::collider(size_t index) {
+	return _colliders[index];
+}
+
+void TileCollisionGrid::_bake(const LayerConfig& layer) {
+	// repeated layers can spill past the map size, so size the grid to fit every tile.
+	for (const auto& tile : layer.tiles) {
+		_width = std::max(_width, tile.x + 1);
+		_height = std::max(_height, tile.y + 1);
+	}
+	_cells.assign(_width * _height, -1);
+
+	// only full tile colliders can be merged, anything else is added on its own.
+	std::vector<const TileSetTileConfig*> mergeable(_width * _height, nullptr);
+	for (const auto& tile : layer.tiles) {
+		if (tile.id <= 0) {
+			continue;
+		}
+		const TileSetTileConfig& tconf = layer.tileset.tiles[tile.id - 1];
+		if (tconf.aabb.width <= 0 || tconf.aabb.height <= 0) {
+			continue;
+		}
+		if (tconf.aabb.width == _tile_width && tconf.aabb.height == _tile_height) {
+			mergeable[tile.y * _width + tile.x] = &tconf;
+		}
+		else {
+			_add_rect(tile.x, tile.y, tile.x, tile.y, tconf);
+		}
+	}
+
+	std::vector<TileRect> rects;
+	std::vector<TileRun> previous;
+	std::vector<TileRun> current;
+	for (unsigned int y = 0; y < _height; y++) {
+		current.clear();
+		unsigned int x = 0;
+		size_t p = 0;
+		while (x < _width) {
+			const TileSetTileConfig* tconf = mergeable[y * _width + x];
+			if (tconf == nullptr) {
+				x++;
+				continue;
+			}
+			unsigned int start = x;
+			while (x < _width && same_collider(mergeable[y * _width + x], tconf)) {
+				x++;
+			}
+			unsigned int end = x - 1;
+
+			// previous is ordered by x, so only walk forward to find a run with the same span.
+			while (p < previous.size() && previous[p].x0 < start) {
+				p++;
+			}
+			if (p < previous.size() && previous[p].x0 == start && previous[p].x1 == end && same_collider(rects[previous[p].rect].tconf, tconf)) {
+				rects[previous[p].rect].y1 = y;
+				current.push_back(TileRun{ start, end, previous[p].rect });
+			}
+			else {
+				rects.push_back(TileRect{ start, y, end, y, tconf });
+				current.push_back(TileRun{ start, end, rects.size() - 1 });
+			}
+		}
+		std::swap(previous, current);
+	}
+
+	for (const auto& r : rects) {
+		_add_rect(r.x0, r.y0, r.x1, r.y1, *r.tconf);
+	}
+	_query_marks.assign(_colliders.size(), 0);
+}
+
+void TileCollisionGrid::_add_rect(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, const TileSetTileConfig& tconf) {
+	int index = (int)_colliders.size();
+
+	float left = (float)x0 * _tile_width;
+	float top = (float)y0 * _tile_height;
+	float right = (float)(x1 + 1) * _tile_width;
+	float bottom = (float)(y1 + 1) * _tile_height;
+
+	sf::Vector2f half_size;
+	if (x0 == x1 && y0 == y1) {
+		// a single tile keeps its configured collider size, centered on the tile.
+		half_size = sf::Vector2f(tconf.aabb.width / 2.0f, tconf.aabb.height / 2.0f);
+		int overhang_x = (int)std::ceil((half_size.x - _tile_width / 2.0f) / _tile_width);
+		int overhang_y = (int)std::ceil((half_size.y - _tile_height / 2.0f) / _tile_height);
+		_overhang = std::max(_overhang, std::max(overhang_x, overhang_y));
+	}
+	else {
+		half_size = sf::Vector2f((right - left) / 2.0f, (bottom - top) / 2.0f);
+	}
+
+	_colliders.push_back(StaticCollider{
+		sf::Vector2f((left + right) / 2.0f, (top + bottom) / 2.0f),
+		half_size,
+		tconf.passage ? AABB::Material::Permeable : AABB::Material::Solid,
+		tconf.damage,
+		tconf.hardness,
+		tconf.piercing,
+		false
+	});
+
+	for (unsigned int y = y0; y <= y1; y++) {
+		for (unsigned int x = x0; x <= x1; x++) {
+			_cells[y * _width + x] = index;
+		}
+	}
+}
+
+int TileCollisionGrid::_cell(int x, int y) const {
+	return _cells[y * _width + x];
+}
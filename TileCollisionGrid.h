@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Components.h"
+#include "MapManager.h"
+
+// A collider that never moves. These live outside the ECS so they skip the
+// double buffering, sorting and broadphase entirely.
+struct StaticCollider {
+	sf::Vector2f position;
+	sf::Vector2f half_size;
+	AABB::Material material;
+	int damage;
+	int hardness;
+	int piercing;
+
+	// for rendering:
+	// if a collision happened this tick
+	bool collision;
+};
+
+// The solid tiles of one layer baked into a dense grid. Neighbouring tiles with
+// the same collider settings are merged into larger rectangles, first into runs
+// along a row and then runs with the same span are merged down the rows.
+// Each cell stores which rectangle covers it, so a lookup is just an index.
+class TileCollisionGrid {
+public:
+	TileCollisionGrid();
+	TileCollisionGrid(const Map& map, unsigned int layer);
+
+	// Appends the index of every collider touching the box. Each index is appended once.
+	void query(const sf::Vector2f& position, const sf::Vector2f& half_size, std::vector<size_t>& out) const;
+	// Calls f(index) for every collider touching the box, each collider once.
+	// Stops and returns true as soon as f returns true.
+	template <typename F>
+	bool visit(const sf::Vector2f& position, const sf::Vector2f& half_size, F&& f) const;
+
+	size_t size() const;
+	const StaticCollider& collider(size_t index) const;
+	StaticCollider& collider(size_t index);
+
+private:
+	void _bake(const LayerConfig& layer);
+	void _add_rect(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, const TileSetTileConfig& tconf);
+	int _cell(int x, int y) const;
+
+	unsigned int _width;
+	unsigned int _height;
+	float _tile_width;
+	float _tile_height;
+	// colliders smaller than a tile are kept as-is, but if one was ever bigger than
+	// its tile, queries need to look this many extra cells around the box.
+	int _overhang;
+
+	// index into _colliders or -1 if the cell is empty.
+	std::vector<int> _cells;
+	std::vector<StaticCollider> _colliders;
+	// used to report each collider once per query.
+	mutable std::vector<unsigned int> _query_marks;
+	mutable unsigned int _query_mark;
+};
+
+template <typename F>
+bool TileCollisionGrid::visit(const sf::Vector2f& position, const sf::Vector2f& half_size, F&& f) const {
+	if (_colliders.empty()) {
+		return false;
+	}
+
+	int min_x = std::max(0, (int)std::floor((position.x - half_size.x) / _tile_width) - _overhang);
+	int min_y = std::max(0, (int)std::floor((position.y - half_size.y) / _tile_height) - _overhang);
+	int max_x = std::min((int)_width - 1, (int)std::floor((position.x + half_size.x) / _tile_width) + _overhang);
+	int max_y = std::min((int)_height - 1, (int)std::floor((position.y + half_size.y) / _tile_height) + _overhang);
+
+	_query_mark++;
+	for (int y = min_y; y <= max_y; y++) {
+		for (int x = min_x; x <= max_x; x++) {
+			int index = _cell(x, y);
+			if (index < 0 || _query_marks[index] == _query_mark) {
+				continue;
+			}
+			_query_marks[index] = _query_mark;
+			if (f((size_t)index)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -2,6 +2,7 @@
 #include <cmath>
 #include <cstdlib>
 
+#include <fstream>
 #include <iostream>
 #include <functional>
 #include <optional>
@@ -15,8 +16,76 @@
 #include "IFileManager.h"
 #include "FstreamFileManager.h"
 #include "GameManager.h"
+#include "GameScene.h"
+#include "LevelGenerator.h"
 #include "MapManager.h"
 #include "MenuScene.h"
+#include "SystemTimings.h"
+
+namespace {
+	// Runs every level of level_sweep() headless for ticks and writes a row of
+	// ticks/s and per-system p50s to csv_path for each one. Every level gets a
+	// GameManager of its own so nothing carries over between runs.
+	bool sweep_levels(std::shared_ptr<IFileManager> file_manager, uint64_t ticks, const std::string& csv_path, const std::optional<std::string>& script_path) {
+		std::ofstream csv(csv_path, std::ios::trunc);
+		if (!csv) {
+			std::cerr << "Failed to open " << csv_path << "\n";
+			return false;
+		}
+
+		MapManager maps(file_manager);
+		bool header = false;
+		for (const auto& point : level_sweep()) {
+			std::ostringstream source;
+			generate_level(point.level, source);
+			auto level = maps.parse_level(source.str(), "generated " + point.series);
+			if (!level) {
+				return false;
+			}
+
+			std::unique_ptr<AssetManager> asset_manager = std::make_unique<AssetManager>();
+			if (!asset_manager->load_db(file_manager, "assets/assets.txt")) {
+				return false;
+			}
+			GameManager game(file_manager, std::move(asset_manager), std::make_unique<MapManager>(file_manager), nullptr);
+			if (script_path && !game.Script(script_path.value())) {
+				std::cerr << "Failed to read input script " << script_path.value() << "\n";
+				return false;
+			}
+			SystemTimings timings;
+			game.SetSystemTimings(&timings);
+			game.PushScene(std::make_unique<GameScene>(level.value()));
+
+			sf::Clock clock;
+			uint64_t ran = game.RunHeadless(ticks);
+			float seconds = clock.getElapsedTime().asSeconds();
+			float ticks_per_s = seconds > 0.0f ? ran / seconds : 0.0f;
+
+			if (!header) {
+				csv << "series,width,layers,density,scripted_entities,spawners,ticks,seconds,ticks_per_s,tick_p50_us,tick_p99_us";
+				for (size_t i = 0; i < timings.size(); i++) {
+					csv << "," << timings.name(i) << "_p50_us";
+				}
+				csv << "\n";
+				header = true;
+			}
+			const auto& l = point.level;
+			csv << point.series << "," << l.width << "," << l.layers << "," << l.density << ","
+				<< l.scripted_entities << "," << l.spawners << ","
+				<< ran << "," << seconds << "," << ticks_per_s << ","
+				<< timings.tick_percentile(50) << "," << timings.tick_percentile(99);
+			for (size_t i = 0; i < timings.size(); i++) {
+				csv << "," << timings.percentile(i, 50);
+			}
+			csv << "\n";
+
+			std::cout << point.series << ": width " << l.width << ", layers " << l.layers << ", density " << l.density
+				<< ", scripted " << l.scripted_entities << ", spawners " << l.spawners
+				<< ": " << ticks_per_s << " ticks/s\n";
+		}
+		return (bool)csv;
+	}
+}
 
 int main(int argc, char* argv[]) {
 	srand(0);
@@ -39,8 +108,91 @@ int main(int argc, char* argv[]) {
 		return -1;
 	}
 
-	std::unique_ptr<sf::RenderWindow> window = std::make_unique<sf::RenderWindow>(sf::VideoMode(config.window.width, config.window.height, 32), "Not Mario I swear");
-	//window->setFramerateLimit(config.window.framerate);
+	// --record <file> saves the input of this run, --replay <file> plays one back.
+	// --headless <level> <ticks> runs a level without a window and prints how
+	// long each system took, on input from --script <file> or --replay.
+	// --profile <file> writes a Chrome trace of the systems on exit.
+	// --generate <file> writes a stress level sized by --width, --layers,
+	// --density, --scripted, --spawners and --seed, which --headless can run.
+	// --sweep <ticks> <csv> runs a series of generated levels headless and
+	// writes their ticks/s to a csv for plotting.
+	std::optional<std::string> record_path;
+	std::optional<std::string> profile_path;
+	std::optional<std::string> replay_path;
+	std::optional<std::string> script_path;
+	std::optional<std::string> headless_level;
+	uint64_t headless_ticks = 0;
+	std::optional<std::string> generate_path;
+	LevelGeneratorConfig generate;
+	std::optional<std::string> sweep_path;
+	uint64_t sweep_ticks = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc) {
+			record_path = argv[++i];
+		}
+		else if (arg == "--replay" && i + 1 < argc) {
+			replay_path = argv[++i];
+		}
+		else if (arg == "--script" && i + 1 < argc) {
+			script_path = argv[++i];
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			profile_path = argv[++i];
+		}
+		else if (arg == "--headless" && i + 2 < argc) {
+			headless_level = argv[++i];
+			headless_ticks = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--generate" && i + 1 < argc) {
+			generate_path = argv[++i];
+		}
+		else if (arg == "--width" && i + 1 < argc) {
+			generate.width = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--layers" && i + 1 < argc) {
+			generate.layers = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--density" && i + 1 < argc) {
+			generate.density = std::strtof(argv[++i], nullptr);
+		}
+		else if (arg == "--scripted" && i + 1 < argc) {
+			generate.scripted_entities = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--spawners" && i + 1 < argc) {
+			generate.spawners = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--seed" && i + 1 < argc) {
+			generate.seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--sweep" && i + 2 < argc) {
+			sweep_ticks = std::strtoull(argv[++i], nullptr, 10);
+			sweep_path = argv[++i];
+		}
+		else {
+			std::cerr << "Unknown or incomplete argument " << arg << "\n";
+			return -1;
+		}
+	}
+
+	if (generate_path) {
+		std::ofstream out(generate_path.value(), std::ios::trunc);
+		generate_level(generate, out);
+		if (!out) {
+			std::cerr << "Failed to write level " << generate_path.value() << "\n";
+			return -1;
+		}
+		return 0;
+	}
+	if (sweep_path) {
+		return sweep_levels(std::make_shared<FstreamFileManager>(), sweep_ticks, sweep_path.value(), script_path) ? 0 : -1;
+	}
+
+	std::unique_ptr<sf::RenderWindow> window;
+	if (!headless_level) {
+		window = std::make_unique<sf::RenderWindow>(sf::VideoMode(config.window.width, config.window.height, 32), "Not Mario I swear");
+		//window->setFramerateLimit(config.window.framerate);
+	}
 
 	std::shared_ptr<IFileManager> file_manager = std::make_shared<FstreamFileManager>();
 
@@ -55,10 +207,52 @@ int main(int argc, char* argv[]) {
 	}
 
 	GameManager game(file_manager, std::move(asset_manager), std::move(map_manager), std::move(window));
-	game.PushScene(std::make_unique<MenuScene>());
 
-	// This is the main game loop that runs until quit.
-	game.RunLoop();
+	if (record_path && !game.Record(record_path.value())) {
+		std::cerr << "Failed to open " << record_path.value() << " for recording\n";
+		return -1;
+	}
+	if (replay_path && !game.Replay(replay_path.value())) {
+		std::cerr << "Failed to open replay " << replay_path.value() << "\n";
+		return -1;
+	}
+	if (script_path && !game.Script(script_path.value())) {
+		std::cerr << "Failed to read input script " << script_path.value() << "\n";
+		return -1;
+	}
+	game.profiler().set_tracing((bool)profile_path);
+	game.profiler().set_enabled((bool)profile_path);
+
+	if (headless_level) {
+		// a level name from maps/levels.txt, or else the path of a level file.
+		auto level = game.map_manager().get_level(headless_level.value());
+		if (!level) {
+			level = game.map_manager().load_level(headless_level.value());
+		}
+		if (!level) {
+			std::cerr << "No level named " << headless_level.value() << "\n";
+			return -1;
+		}
+		SystemTimings timings;
+		game.SetSystemTimings(&timings);
+		game.PushScene(std::make_unique<GameScene>(level.value()));
 
+		sf::Clock clock;
+		uint64_t ran = game.RunHeadless(headless_ticks);
+		float seconds = clock.getElapsedTime().asSeconds();
+		std::cout << ran << " ticks in " << seconds << " s, " << (seconds > 0.0f ? ran / seconds : 0.0f) << " ticks/s\n";
+		timings.report(std::cout);
+	}
+	else {
+		game.PushScene(std::make_unique<MenuScene>());
+
+		// This is the main game loop that runs until quit.
+		game.RunLoop();
+	}
+
+	if (profile_path && !game.profiler().write_chrome_trace(profile_path.value())) {
+		std::cerr << "Failed to write profile " << profile_path.value() << "\n";
+		return -1;
+	}
 	return 0;
 }